@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <command_line.h>
+#include <flock.h>
+#include <main.h>
+#include <profiler.h>
+#include <reorder.h>
+#include <simulation.h>
+#include <snapshot.h>
+#include <spatial_index.h>
+#include <workers.h>
+
+// FNV-1a over the boid positions, for comparing runs across thread counts.
+unsigned int flock_checksum(struct Flock *flock) {
+  unsigned int hash = 2166136261u;
+  unsigned char *bytes[2] = {(unsigned char *)flock->x,
+                             (unsigned char *)flock->y};
+
+  for (int k = 0; k < 2; k++) {
+    for (size_t i = 0; i < sizeof(float) * flock->count; i++) {
+      hash = (hash ^ bytes[k][i]) * 16777619u;
+    }
+  }
+
+  return hash;
+}
+
+// Leaf capacity for quadtrees built by the benchmarks.
+int leaf_capacity = QUADTREE_DEFAULT_CAPACITY;
+
+// Steps between sorts of the flock by Morton code, or 0 to never sort.
+int reorder_interval = REORDER_INTERVAL;
+
+// Times index construction for 1, 2, 4, ... up to max_threads workers.
+void build_sweep(struct Flock *flock, int index_type, float width,
+                 float height, int max_threads, int repetitions) {
+  printf("%8s %12s %12s %8s\n", "threads", "build ms", "ns/boid", "speedup");
+
+  double serial = 0;
+  for (int threads = 1;; threads *= 2) {
+    if (threads > max_threads) {
+      threads = max_threads;
+    }
+
+    struct Workers workers;
+    workers_init(&workers, threads);
+
+    struct SpatialIndex index = {0};
+    index.type = index_type;
+    quadtree_configure(&index.quadtree, leaf_capacity, QUADTREE_DEFAULT_DEPTH);
+
+    // Warm-up so buffer growth is not timed.
+    spatial_index_build(&index, flock->x, flock->y, flock->count, width,
+                        height, RADIUS_MAX, &workers);
+    spatial_index_clear(&index);
+
+    double begin = profiler_now();
+    for (int i = 0; i < repetitions; i++) {
+      spatial_index_reset(&index);
+      spatial_index_build(&index, flock->x, flock->y, flock->count, width,
+                          height, RADIUS_MAX, &workers);
+      spatial_index_clear(&index);
+    }
+    double elapsed = (profiler_now() - begin) / repetitions;
+
+    if (threads == 1) {
+      serial = elapsed;
+    }
+
+    printf("%8d %12.3f %12.2f %8.2f\n", threads, elapsed * 1e3,
+           elapsed * 1e9 / flock->count, serial / elapsed);
+
+    spatial_index_free(&index);
+    workers_free(&workers);
+
+    if (threads == max_threads) {
+      break;
+    }
+  }
+}
+
+// Runs the simulation without any rendering and reports throughput along with
+// the split between index construction and the simulation passes. Steps are
+// numbered from frame, as when resuming from a snapshot, which decides when
+// the flock is sorted.
+void run_steps(struct Flock *flock, struct Widget *widgets, int index_type,
+               int threads, int frame, int steps) {
+  struct Workers workers;
+  workers_init(&workers, threads);
+
+  struct SpatialIndex index = {0};
+  index.type = index_type;
+  quadtree_configure(&index.quadtree, leaf_capacity, QUADTREE_DEFAULT_DEPTH);
+
+  struct Reorder reorder;
+  reorder_init(&reorder, reorder_interval);
+
+  double reorder_time = 0;
+  double build_time = 0;
+  double simulate_time = 0;
+  long moved = 0;
+
+  for (int i = 0; i < steps; i++) {
+    double begin = profiler_now();
+    if (reorder_due(&reorder, flock, frame + i, screen_size.width,
+                    screen_size.height)) {
+      reorder_flock(&reorder, flock, screen_size.width, screen_size.height,
+                    NULL, 0);
+      spatial_index_reset(&index);
+    }
+
+    double t0 = profiler_now();
+    spatial_index_build(&index, flock->x, flock->y, flock->count,
+                        screen_size.width, screen_size.height, RADIUS_MAX,
+                        &workers);
+    double t1 = profiler_now();
+    moved += index.grid.moved;
+    simulate_boids(flock, widgets, NUM_WIDGETS, &index, &workers);
+    double t2 = profiler_now();
+    spatial_index_clear(&index);
+
+    reorder_time += t0 - begin;
+    build_time += t1 - t0;
+    simulate_time += t2 - t1;
+  }
+
+  double total = reorder_time + build_time + simulate_time;
+  double boid_steps = (double)flock->count * steps;
+
+  printf("%-18s %12.2f\n", "steps/sec", steps / total);
+  printf("%-18s %12.2f\n", "ns/boid/step", total * 1e9 / boid_steps);
+  printf("%-18s %12.2f ns/boid/step %5.1f%%, %d sorts\n", "reorder",
+         reorder_time * 1e9 / boid_steps, 100 * reorder_time / total,
+         reorder.count);
+  printf("%-18s %12.2f ns/boid/step %5.1f%%\n", "index build",
+         build_time * 1e9 / boid_steps, 100 * build_time / total);
+  printf("%-18s %12.2f ns/boid/step %5.1f%%\n", "rules + integration",
+         simulate_time * 1e9 / boid_steps, 100 * simulate_time / total);
+  for (int phase = PHASE_MOVE; phase <= PHASE_INTEGRATE; phase++) {
+    struct PhaseStats stats = profiler_stats(phase);
+    printf("  %-16s %12.2f ns/boid/step, p99 %.2f\n", phase_names[phase],
+           stats.avg * 1e9 / flock->count, stats.p99 * 1e9 / flock->count);
+  }
+  if (index_type == INDEX_GRID) {
+    printf("%-18s %12.2f per step, %d rebuilds\n", "grid cell changes",
+           (double)moved / steps, index.grid.rebuilds);
+  }
+  printf("%-18s %12.8x\n", "checksum", flock_checksum(flock));
+
+  reorder_free(&reorder);
+  spatial_index_free(&index);
+  workers_free(&workers);
+}
+
+// Runs the same steps from the same start with quadtrees of each leaf
+// capacity, to find the one with the lowest build plus query time.
+void capacity_sweep(struct Flock *flock, struct Widget *widgets, int threads,
+                    int frame, int steps) {
+  printf("%8s %12s %12s %12s %8s %8s\n", "capacity", "build", "rules",
+         "total", "nodes", "KiB");
+
+  struct Workers workers;
+  workers_init(&workers, threads);
+
+  struct Flock copy;
+  flock_init(&copy, flock->count);
+  struct RandomState start = random_state;
+
+  for (int capacity = 1; capacity <= QUADTREE_MAX_CAPACITY; capacity *= 2) {
+    flock_copy(&copy, flock);
+    random_state = start;
+
+    struct SpatialIndex index = {0};
+    index.type = INDEX_QUADTREE;
+    quadtree_configure(&index.quadtree, capacity, QUADTREE_DEFAULT_DEPTH);
+
+    struct Reorder reorder;
+    reorder_init(&reorder, reorder_interval);
+
+    double build_time = 0;
+    double simulate_time = 0;
+    int nodes = 0;
+
+    for (int i = 0; i < steps; i++) {
+      if (reorder_due(&reorder, &copy, frame + i, screen_size.width,
+                      screen_size.height)) {
+        reorder_flock(&reorder, &copy, screen_size.width, screen_size.height,
+                      NULL, 0);
+      }
+
+      double t0 = profiler_now();
+      spatial_index_build(&index, copy.x, copy.y, copy.count,
+                          screen_size.width, screen_size.height, RADIUS_MAX,
+                          &workers);
+      double t1 = profiler_now();
+      simulate_boids(&copy, widgets, NUM_WIDGETS, &index, &workers);
+      double t2 = profiler_now();
+      nodes = index.quadtree.numNodes;
+      spatial_index_clear(&index);
+
+      build_time += t1 - t0;
+      simulate_time += t2 - t1;
+    }
+
+    double boid_steps = (double)copy.count * steps;
+    size_t node_size = sizeof(struct QuadtreeNode) +
+                       sizeof(struct QuadtreePoint) * capacity;
+    printf("%8d %12.2f %12.2f %12.2f %8d %8zu\n", capacity,
+           build_time * 1e9 / boid_steps, simulate_time * 1e9 / boid_steps,
+           (build_time + simulate_time) * 1e9 / boid_steps, nodes,
+           nodes * node_size / 1024);
+
+    reorder_free(&reorder);
+    spatial_index_free(&index);
+  }
+
+  random_state = start;
+  flock_free(&copy);
+  workers_free(&workers);
+}
+
+int main(int argc, char *argv[]) {
+  add_arg('a', "save", "Write a snapshot after the steps.");
+  add_arg('b', "build-sweep", "Time index construction against threads.");
+  add_arg('c', "capacity", "Quadtree leaf capacity (default 32).");
+  add_arg('i', "index", "Spatial index: quadtree or grid (default grid).");
+  add_arg('k', "steps", "Number of simulation steps (default 1000).");
+  add_arg('l', "load", "Start from a snapshot instead of random positions.");
+  add_arg('n', "num", "Number of boids (default 100000).");
+  add_arg('q', "capacity-sweep", "Time quadtree steps against leaf capacity.");
+  add_arg('r', "repetitions", "Repetitions per sweep point (default 20).");
+  add_arg('s', "seed", "Seed to use for random generation (default 0).");
+  add_arg('t', "threads", "Threads, or most threads to sweep (default all).");
+  add_arg('x', "width", "World width (default 1200).");
+  add_arg('y', "height", "World height (default 700).");
+  add_arg('z', "reorder", "Steps between Morton sorts, 0 for none (default 500).");
+
+  parse_opts(argc, argv);
+
+  int index_type = INDEX_GRID;
+  if (get_is_set('i')) {
+    index_type = spatial_index_type(get_value('i'));
+
+    if (index_type == -1) {
+      fprintf(stderr, "Unknown spatial index: %s\n", get_value('i'));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int num_boids = get_is_set('n') ? atoi(get_value('n')) : 100000;
+  int steps = get_is_set('k') ? atoi(get_value('k')) : 1000;
+  int repetitions = get_is_set('r') ? atoi(get_value('r')) : 20;
+  int seed = get_is_set('s') ? atoi(get_value('s')) : 0;
+  int threads =
+      get_is_set('t') ? atoi(get_value('t')) : workers_default_count();
+
+  if (get_is_set('c')) {
+    leaf_capacity = atoi(get_value('c'));
+  }
+
+  if (get_is_set('z')) {
+    reorder_interval = atoi(get_value('z'));
+  }
+
+  screen_size.width = get_is_set('x') ? atoi(get_value('x')) : 1200;
+  screen_size.height = get_is_set('y') ? atoi(get_value('y')) : 700;
+
+  if (num_boids < 1) {
+    num_boids = 1;
+  }
+  if (steps < 1) {
+    steps = 1;
+  }
+  if (repetitions < 1) {
+    repetitions = 1;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  random_state.seed = seed;
+
+  struct Widget widgets[NUM_WIDGETS];
+  initialize_widgets(widgets);
+
+  // A snapshot replaces the boids, world size and random state set above.
+  struct Flock flock;
+  int frame = 0;
+  if (get_is_set('l')) {
+    flock_init(&flock, 0);
+    frame = snapshot_load(get_value('l'), &flock, widgets);
+    num_boids = flock.count;
+  } else {
+    flock_init(&flock, num_boids);
+    initialize_positions(&flock, num_boids);
+  }
+
+  if (get_is_set('q')) {
+    printf("Quadtree leaf capacity: %d boids, %d steps, %dx%d world, "
+           "ns/boid/step\n",
+           flock.count, steps, screen_size.width, screen_size.height);
+    capacity_sweep(&flock, widgets, threads, frame, steps);
+  } else if (get_is_set('b')) {
+    printf("Index build: %d boids, %dx%d world\n", num_boids,
+           screen_size.width, screen_size.height);
+    build_sweep(&flock, index_type, screen_size.width, screen_size.height,
+                threads, repetitions);
+  } else {
+    printf("Simulation: %d boids, %d steps, %d threads, %dx%d world\n",
+           num_boids, steps, threads, screen_size.width, screen_size.height);
+    run_steps(&flock, widgets, index_type, threads, frame, steps);
+
+    if (get_is_set('a')) {
+      snapshot_save(get_value('a'), &flock, widgets, &random_state,
+                    frame + steps);
+    }
+  }
+
+  flock_free(&flock);
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <flock.h>
+
+float *flock_alloc_array(int capacity) {
+  size_t size = sizeof(float) * capacity;
+  size = (size + FLOCK_ALIGNMENT - 1) / FLOCK_ALIGNMENT * FLOCK_ALIGNMENT;
+  if (size == 0) {
+    size = FLOCK_ALIGNMENT;
+  }
+
+  float *array = aligned_alloc(FLOCK_ALIGNMENT, size);
+  memset(array, 0, size);
+  return array;
+}
+
+void flock_init(struct Flock *flock, int capacity) {
+  flock->count = 0;
+  flock->capacity = capacity;
+
+  flock->x = flock_alloc_array(capacity);
+  flock->y = flock_alloc_array(capacity);
+  flock->prev_x = flock_alloc_array(capacity);
+  flock->prev_y = flock_alloc_array(capacity);
+  flock->vx = flock_alloc_array(capacity);
+  flock->vy = flock_alloc_array(capacity);
+  for (int i = 0; i < 4; i++) {
+    flock->steer_x[i] = flock_alloc_array(capacity);
+    flock->steer_y[i] = flock_alloc_array(capacity);
+  }
+}
+
+float *flock_grow_array(float *array, int count, int capacity) {
+  float *grown = flock_alloc_array(capacity);
+  memcpy(grown, array, sizeof(float) * count);
+  free(array);
+  return grown;
+}
+
+// Grows storage to hold at least capacity boids, at least doubling it so
+// adding boids one at a time stays amortized O(1).
+void flock_reserve(struct Flock *flock, int capacity) {
+  if (capacity <= flock->capacity) {
+    return;
+  }
+
+  if (capacity < flock->capacity * 2) {
+    capacity = flock->capacity * 2;
+  }
+
+  flock->x = flock_grow_array(flock->x, flock->count, capacity);
+  flock->y = flock_grow_array(flock->y, flock->count, capacity);
+  flock->prev_x = flock_grow_array(flock->prev_x, flock->count, capacity);
+  flock->prev_y = flock_grow_array(flock->prev_y, flock->count, capacity);
+  flock->vx = flock_grow_array(flock->vx, flock->count, capacity);
+  flock->vy = flock_grow_array(flock->vy, flock->count, capacity);
+  for (int i = 0; i < 4; i++) {
+    flock->steer_x[i] =
+        flock_grow_array(flock->steer_x[i], flock->count, capacity);
+    flock->steer_y[i] =
+        flock_grow_array(flock->steer_y[i], flock->count, capacity);
+  }
+
+  flock->capacity = capacity;
+}
+
+void flock_free(struct Flock *flock) {
+  free(flock->x);
+  free(flock->y);
+  free(flock->prev_x);
+  free(flock->prev_y);
+  free(flock->vx);
+  free(flock->vy);
+  for (int i = 0; i < 4; i++) {
+    free(flock->steer_x[i]);
+    free(flock->steer_y[i]);
+  }
+  memset(flock, 0, sizeof(struct Flock));
+}
+
+// Remembers the current positions as the start of the next step.
+void flock_save_positions(struct Flock *flock) {
+  memcpy(flock->prev_x, flock->x, sizeof(float) * flock->count);
+  memcpy(flock->prev_y, flock->y, sizeof(float) * flock->count);
+}
+
+// Makes dst hold the same boids as src, growing it if needed.
+void flock_copy(struct Flock *dst, const struct Flock *src) {
+  flock_reserve(dst, src->count);
+
+  size_t size = sizeof(float) * src->count;
+  memcpy(dst->x, src->x, size);
+  memcpy(dst->y, src->y, size);
+  memcpy(dst->prev_x, src->prev_x, size);
+  memcpy(dst->prev_y, src->prev_y, size);
+  memcpy(dst->vx, src->vx, size);
+  memcpy(dst->vy, src->vy, size);
+  for (int i = 0; i < 4; i++) {
+    memcpy(dst->steer_x[i], src->steer_x[i], size);
+    memcpy(dst->steer_y[i], src->steer_y[i], size);
+  }
+
+  dst->count = src->count;
+}
+
+float *flock_gather_array(float *array, const int *order, int count,
+                          int capacity) {
+  float *gathered = flock_alloc_array(capacity);
+  for (int i = 0; i < count; i++) {
+    gathered[i] = array[order[i]];
+  }
+  free(array);
+  return gathered;
+}
+
+// Reorders the boids so the one at order[i] moves to i.
+void flock_permute(struct Flock *flock, const int *order) {
+  int n = flock->count;
+  int c = flock->capacity;
+
+  flock->x = flock_gather_array(flock->x, order, n, c);
+  flock->y = flock_gather_array(flock->y, order, n, c);
+  flock->prev_x = flock_gather_array(flock->prev_x, order, n, c);
+  flock->prev_y = flock_gather_array(flock->prev_y, order, n, c);
+  flock->vx = flock_gather_array(flock->vx, order, n, c);
+  flock->vy = flock_gather_array(flock->vy, order, n, c);
+  for (int i = 0; i < 4; i++) {
+    flock->steer_x[i] = flock_gather_array(flock->steer_x[i], order, n, c);
+    flock->steer_y[i] = flock_gather_array(flock->steer_y[i], order, n, c);
+  }
+}
+
+// Makes dst hold the positions and velocities of src, leaving its steering
+// vectors as they were.
+void flock_copy_motion(struct Flock *dst, const struct Flock *src) {
+  flock_reserve(dst, src->count);
+
+  size_t size = sizeof(float) * src->count;
+  memcpy(dst->x, src->x, size);
+  memcpy(dst->y, src->y, size);
+  memcpy(dst->prev_x, src->prev_x, size);
+  memcpy(dst->prev_y, src->prev_y, size);
+  memcpy(dst->vx, src->vx, size);
+  memcpy(dst->vy, src->vy, size);
+
+  dst->count = src->count;
+}
+
+// Gathers one boid into the array-of-structs form used by the renderer.
+void flock_get(struct Flock *flock, int i, struct Boid *boid) {
+  boid->x = flock->x[i];
+  boid->y = flock->y[i];
+  boid->vx = flock->vx[i];
+  boid->vy = flock->vy[i];
+  for (int j = 0; j < 4; j++) {
+    boid->steer_x[j] = flock->steer_x[j][i];
+    boid->steer_y[j] = flock->steer_y[j][i];
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef FLOCK_H
+#define FLOCK_H
+
+#include <main.h>
+
+#define FLOCK_ALIGNMENT 64
+
+// Structure-of-arrays boid storage. Each field is a separate cache-line
+// aligned array so the simulation passes only stream the fields they use.
+struct Flock {
+  int count;
+  int capacity;
+
+  float *x;
+  float *y;
+
+  // Positions before the last step, for drawing between steps.
+  float *prev_x;
+  float *prev_y;
+
+  // Unit velocity, the direction the boid is heading in.
+  float *vx;
+  float *vy;
+
+  // Per-rule unit steering vectors: separation, alignment, cohesion and noise.
+  float *steer_x[4];
+  float *steer_y[4];
+};
+
+void flock_init(struct Flock *flock, int capacity);
+
+void flock_reserve(struct Flock *flock, int capacity);
+
+void flock_free(struct Flock *flock);
+
+void flock_save_positions(struct Flock *flock);
+
+void flock_copy(struct Flock *dst, const struct Flock *src);
+
+void flock_copy_motion(struct Flock *dst, const struct Flock *src);
+
+void flock_permute(struct Flock *flock, const int *order);
+
+void flock_get(struct Flock *flock, int i, struct Boid *boid);
+
+#endif
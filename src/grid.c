@@ -0,0 +1,306 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <grid.h>
+
+int grid_cell_coord(float v, float cell_size, int max) {
+  int c = (int)(v / cell_size);
+
+  if (c < 0) {
+    return 0;
+  }
+
+  if (c >= max) {
+    return max - 1;
+  }
+
+  return c;
+}
+
+int grid_cell_slack(int count) {
+  return GRID_CELL_SLACK + count / GRID_CELL_SLACK_DIVISOR;
+}
+
+void grid_reserve(struct Grid *g, int num_cells, int num_ids,
+                  int num_workers) {
+  if (num_cells + 1 > g->cellCapacity) {
+    g->cellCapacity = num_cells + 1;
+    g->cellStart = realloc(g->cellStart, sizeof(int) * g->cellCapacity);
+    g->cellCount = realloc(g->cellCount, sizeof(int) * g->cellCapacity);
+  }
+
+  if (num_ids > g->idCapacity) {
+    g->idCapacity = num_ids;
+    g->cellOf = realloc(g->cellOf, sizeof(int) * g->idCapacity);
+    g->slotOf = realloc(g->slotOf, sizeof(int) * g->idCapacity);
+    g->movedIds = realloc(g->movedIds, sizeof(int) * g->idCapacity);
+  }
+
+  // Upper bound on the counts plus the per-cell slack.
+  int num_slots = num_ids + num_ids / GRID_CELL_SLACK_DIVISOR +
+                  num_cells * GRID_CELL_SLACK;
+  if (num_slots > g->slotCapacity) {
+    g->slotCapacity = num_slots;
+    g->ids = realloc(g->ids, sizeof(int) * g->slotCapacity);
+  }
+
+  if (num_cells * num_workers > g->offsetCapacity) {
+    g->offsetCapacity = num_cells * num_workers;
+    g->offsets = realloc(g->offsets, sizeof(int) * g->offsetCapacity);
+  }
+
+  if (num_workers > g->workerCapacity) {
+    g->workerCapacity = num_workers;
+    g->movedBegin = realloc(g->movedBegin, sizeof(int) * g->workerCapacity);
+    g->movedCount = realloc(g->movedCount, sizeof(int) * g->workerCapacity);
+  }
+}
+
+struct GridBuild {
+  struct Grid *g;
+  const float *x;
+  const float *y;
+};
+
+int grid_cell(struct Grid *g, float x, float y) {
+  int cx = grid_cell_coord(x, g->cell_size, g->cols);
+  int cy = grid_cell_coord(y, g->cell_size, g->rows);
+  return cy * g->cols + cx;
+}
+
+// Per-worker histogram of the cells in this worker's range of boids.
+void grid_count_pass(void *context, int begin, int end, int worker) {
+  struct GridBuild *build = context;
+  struct Grid *g = build->g;
+  int *counts = &g->offsets[worker * g->numCells];
+
+  memset(counts, 0, sizeof(int) * g->numCells);
+
+  for (int i = begin; i < end; i++) {
+    int c = grid_cell(g, build->x[i], build->y[i]);
+    g->cellOf[i] = c;
+    counts[c]++;
+  }
+}
+
+// Turns each cell's per-worker counts into offsets within the cell and stores
+// the cell total in cellCount.
+void grid_offset_pass(void *context, int begin, int end, int worker) {
+  struct GridBuild *build = context;
+  struct Grid *g = build->g;
+
+  for (int c = begin; c < end; c++) {
+    int total = 0;
+    for (int w = 0; w < g->numWorkers; w++) {
+      int count = g->offsets[w * g->numCells + c];
+      g->offsets[w * g->numCells + c] = total;
+      total += count;
+    }
+    g->cellCount[c] = total;
+  }
+}
+
+void grid_scatter_pass(void *context, int begin, int end, int worker) {
+  struct GridBuild *build = context;
+  struct Grid *g = build->g;
+  int *offsets = &g->offsets[worker * g->numCells];
+
+  for (int i = begin; i < end; i++) {
+    int c = g->cellOf[i];
+    int slot = g->cellStart[c] + offsets[c];
+    g->ids[slot] = i;
+    g->slotOf[i] = slot;
+    offsets[c]++;
+  }
+}
+
+// Counting sort of boid ids into flat per-cell ranges, split across workers.
+// Worker ranges are ordered and each worker fills its own slice of every cell,
+// so the result is identical for any number of workers. Each cell range is
+// followed by some free slots that grid_update fills as boids move in.
+// Storage is only reallocated when the boid count, world size or worker count
+// grows, so steady-state rebuilds do not touch the allocator.
+void grid_build(struct Grid *g, const float *x, const float *y, int num_boids,
+                float w, float h, float cell_size, struct Workers *workers) {
+  g->w = w;
+  g->h = h;
+  g->cell_size = cell_size;
+  g->cols = (int)ceil(w / cell_size);
+  g->rows = (int)ceil(h / cell_size);
+  if (g->cols < 1) {
+    g->cols = 1;
+  }
+  if (g->rows < 1) {
+    g->rows = 1;
+  }
+  g->numCells = g->cols * g->rows;
+  g->numWorkers = workers->count;
+  g->numBoids = num_boids;
+  g->stale = false;
+
+  grid_reserve(g, g->numCells, num_boids, g->numWorkers);
+
+  struct GridBuild build;
+  build.g = g;
+  build.x = x;
+  build.y = y;
+
+  workers_run(workers, grid_count_pass, &build, num_boids);
+  workers_run(workers, grid_offset_pass, &build, g->numCells);
+
+  int start = 0;
+  for (int c = 0; c < g->numCells; c++) {
+    g->cellStart[c] = start;
+    start += g->cellCount[c] + grid_cell_slack(g->cellCount[c]);
+  }
+  g->cellStart[g->numCells] = start;
+
+  workers_run(workers, grid_scatter_pass, &build, num_boids);
+}
+
+// Collects the boids in this worker's range whose cell changed.
+void grid_check_pass(void *context, int begin, int end, int worker) {
+  struct GridBuild *build = context;
+  struct Grid *g = build->g;
+  int *moved = &g->movedIds[begin];
+  int n = 0;
+
+  for (int i = begin; i < end; i++) {
+    if (grid_cell(g, build->x[i], build->y[i]) != g->cellOf[i]) {
+      moved[n] = i;
+      n++;
+    }
+  }
+
+  g->movedBegin[worker] = begin;
+  g->movedCount[worker] = n;
+}
+
+// Moves only the boids whose cell changed since the last build or update,
+// each in O(1) by swapping with the last id of its old cell and appending to
+// the free slots of its new one. The grid is rebuilt when a cell runs out of
+// free slots, or when the boid count or world size has changed.
+//
+// Finding the boids that changed cell is split across the workers. Moving them
+// is serial, but visits them in id order as a single pass would, so the
+// result is identical for any number of workers.
+void grid_update(struct Grid *g, const float *x, const float *y, int num_boids,
+                 float w, float h, float cell_size, struct Workers *workers) {
+  if (g->stale || g->numBoids != num_boids || g->w != w || g->h != h ||
+      g->cell_size != cell_size) {
+    grid_build(g, x, y, num_boids, w, h, cell_size, workers);
+    return;
+  }
+
+  grid_reserve(g, g->numCells, num_boids, workers->count);
+
+  struct GridBuild build;
+  build.g = g;
+  build.x = x;
+  build.y = y;
+
+  workers_run(workers, grid_check_pass, &build, num_boids);
+
+  g->moved = 0;
+
+  for (int k = 0; k < workers->count; k++) {
+    int *moved = &g->movedIds[g->movedBegin[k]];
+
+    for (int j = 0; j < g->movedCount[k]; j++) {
+      int i = moved[j];
+      int to = grid_cell(g, x[i], y[i]);
+      int from = g->cellOf[i];
+
+      if (g->cellCount[to] == g->cellStart[to + 1] - g->cellStart[to]) {
+        grid_build(g, x, y, num_boids, w, h, cell_size, workers);
+        g->rebuilds++;
+        return;
+      }
+
+      int slot = g->slotOf[i];
+      int last = g->cellStart[from] + g->cellCount[from] - 1;
+      g->ids[slot] = g->ids[last];
+      g->slotOf[g->ids[slot]] = slot;
+      g->cellCount[from]--;
+
+      slot = g->cellStart[to] + g->cellCount[to];
+      g->ids[slot] = i;
+      g->slotOf[i] = slot;
+      g->cellCount[to]++;
+      g->cellOf[i] = to;
+
+      g->moved++;
+    }
+  }
+}
+
+void grid_free(struct Grid *g) {
+  free(g->cellStart);
+  free(g->cellCount);
+  free(g->cellOf);
+  free(g->slotOf);
+  free(g->ids);
+  free(g->offsets);
+  free(g->movedIds);
+  free(g->movedBegin);
+  free(g->movedCount);
+  memset(g, 0, sizeof(struct Grid));
+}
+
+void grid_query(struct Grid *g, int x, int y, int w, int h,
+                struct Neighbors *result) {
+  int x1 = grid_cell_coord(x, g->cell_size, g->cols);
+  int y1 = grid_cell_coord(y, g->cell_size, g->rows);
+  int x2 = grid_cell_coord(x + w, g->cell_size, g->cols);
+  int y2 = grid_cell_coord(y + h, g->cell_size, g->rows);
+
+  for (int cy = y1; cy <= y2; cy++) {
+    for (int cx = x1; cx <= x2; cx++) {
+      int c = cy * g->cols + cx;
+      int end = g->cellStart[c] + g->cellCount[c];
+      for (int i = g->cellStart[c]; i < end; i++) {
+        neighbors_push(result, g->ids[i]);
+      }
+    }
+  }
+}
+
+// Cells are skipped when their nearest point is outside the circle, which
+// drops the corner cells of the 3x3 block around most boids.
+void grid_query_radius(struct Grid *g, const float *x, const float *y,
+                       float cx, float cy, float radius,
+                       struct Neighbors *result) {
+  float radius_2 = radius * radius;
+  float size = g->cell_size;
+  int x1 = grid_cell_coord(cx - radius, size, g->cols);
+  int y1 = grid_cell_coord(cy - radius, size, g->rows);
+  int x2 = grid_cell_coord(cx + radius, size, g->cols);
+  int y2 = grid_cell_coord(cy + radius, size, g->rows);
+
+  for (int row = y1; row <= y2; row++) {
+    float top = row * size;
+    float ny = cy < top ? top - cy : cy > top + size ? cy - (top + size) : 0;
+
+    for (int col = x1; col <= x2; col++) {
+      float left = col * size;
+      float nx =
+          cx < left ? left - cx : cx > left + size ? cx - (left + size) : 0;
+      if (nx * nx + ny * ny > radius_2) {
+        continue;
+      }
+
+      int c = row * g->cols + col;
+      int end = g->cellStart[c] + g->cellCount[c];
+      for (int i = g->cellStart[c]; i < end; i++) {
+        int id = g->ids[i];
+        float dx = x[id] - cx;
+        float dy = y[id] - cy;
+        float dist_2 = dx * dx + dy * dy;
+        if (dist_2 < radius_2) {
+          neighbors_push_near(result, id, dx, dy, dist_2);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+
+#include <neighbors.h>
+#include <workers.h>
+
+// Free slots left after the ids of a cell holding count boids are
+// GRID_CELL_SLACK + count / GRID_CELL_SLACK_DIVISOR.
+#define GRID_CELL_SLACK 8
+#define GRID_CELL_SLACK_DIVISOR 2
+
+struct Grid {
+  float w;
+  float h;
+  float cell_size;
+  int cols;
+  int rows;
+
+  // Boid ids sorted by cell. Cell c holds cellCount[c] ids starting at
+  // ids[cellStart[c]], and the slots up to cellStart[c+1] are free.
+  int *cellStart;
+  int *cellCount;
+  int *cellOf;
+  int *slotOf;
+  int *ids;
+
+  // Per-worker cell counts, then per-worker write offsets within each cell.
+  int *offsets;
+
+  // Boids whose cell changed, found in parallel by grid_update. Each worker
+  // writes the ids from its range starting at movedIds[movedBegin[worker]].
+  int *movedIds;
+  int *movedBegin;
+  int *movedCount;
+
+  int numCells;
+  int numWorkers;
+  int numBoids;
+  int cellCapacity;
+  int idCapacity;
+  int slotCapacity;
+  int offsetCapacity;
+  int workerCapacity;
+
+  // Forces the next grid_update to rebuild, e.g. after ids are reordered.
+  bool stale;
+
+  // Boids moved by the last grid_update and rebuilds caused by full cells.
+  int moved;
+  int rebuilds;
+};
+
+void grid_build(struct Grid *g, const float *x, const float *y, int num_boids,
+                float w, float h, float cell_size, struct Workers *workers);
+
+void grid_update(struct Grid *g, const float *x, const float *y, int num_boids,
+                 float w, float h, float cell_size, struct Workers *workers);
+
+void grid_free(struct Grid *g);
+
+void grid_query(struct Grid *g, int x, int y, int w, int h,
+                struct Neighbors *result);
+
+// Appends the boids closer than radius to (cx, cy), with their offsets from it.
+void grid_query_radius(struct Grid *g, const float *x, const float *y,
+                       float cx, float cy, float radius,
+                       struct Neighbors *result);
+
+#endif
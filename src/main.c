@@ -6,261 +6,46 @@
 #include <time.h>
 
 #include <command_line.h>
+#include <flock.h>
 #include <main.h>
-#include <quadtree.h>
+#include <profiler.h>
+#include <recording.h>
 #include <render.h>
-
-struct ScreenSize {
-  int width;
-  int height;
-} screen_size = {1200, 700};
-
-float random_float(float low, float high) {
-  return low + (high - low) * (float)rand() / (float)RAND_MAX;
-}
-
-void add_boid(struct Boid *boids, int *num_boids) {
-  if (*num_boids < MAX_BOIDS) {
-    boids[*num_boids].x = random_float(0, screen_size.width);
-    boids[*num_boids].y = random_float(0, screen_size.height);
-    boids[*num_boids].currentHeading = random_float(0, 3.141 * 2);
-    (*num_boids)++;
-  }
-}
-
-void remove_boid(int *num_boids) { (*num_boids)--; }
-
-int initialize_positions(struct Boid *boids, int n) {
-  int num_boids = 0;
-  for (int i = 0; i < n; i++) {
-    add_boid(boids, &num_boids);
-  }
-  return num_boids;
-}
-
-float boid_dist_2(struct Boid *boids, int a, int b) {
-  float dx = boids[a].x - boids[b].x;
-  float dy = boids[a].y - boids[b].y;
-
-  return dx * dx + dy * dy;
-}
-
-float boid_dist(struct Boid *boids, int a, int b) {
-  return sqrt(boid_dist_2(boids, a, b));
-}
-
-// separation: steer to avoid crowding local flockmates
-void rule1(struct Boid *boids, int idx, struct Quadtree *q) {
-  boids[idx].headings[0] = boids[idx].currentHeading;
-
-  int length;
-  int *nearby = quadtree_query(q, boids[idx].x - RADIUS_MIN / 2.0,
-                               boids[idx].y - RADIUS_MIN / 2.0, RADIUS_MIN,
-                               RADIUS_MIN, &length);
-
-  for (int j = 0; j < length; j++) {
-    int i = nearby[j];
-    if (i != idx) {
-      float dist = boid_dist(boids, idx, i);
-      if (dist < RADIUS_MIN) {
-        float dx = boids[idx].x - boids[i].x;
-        float dy = boids[idx].y - boids[i].y;
-        boids[idx].headings[0] = atan2(dy, dx);
-      }
-    }
-  }
-
-  free(nearby);
-}
-
-// alignment: steer towards the average heading of local flockmates
-void rule2(struct Boid *boids, int idx, struct Quadtree *q) {
-  boids[idx].headings[1] = boids[idx].currentHeading;
-
-  float sum_x_heading = 0;
-  float sum_y_heading = 0;
-  int n = 0;
-
-  int length;
-  int *nearby = quadtree_query(q, boids[idx].x - RADIUS_MAX / 2.0,
-                               boids[idx].y - RADIUS_MAX / 2.0, RADIUS_MAX,
-                               RADIUS_MAX, &length);
-
-  for (int j = 0; j < length; j++) {
-    int i = nearby[j];
-    if (i != idx) {
-      float dist = boid_dist(boids, idx, i);
-      if (dist < RADIUS_MAX) {
-        sum_x_heading += cos(boids[i].currentHeading);
-        sum_y_heading += sin(boids[i].currentHeading);
-        n++;
-      }
-    }
-  }
-
-  free(nearby);
-
-  if (n != 0) {
-    boids[idx].headings[1] = atan2(sum_y_heading, sum_x_heading);
-  }
-}
-
-// cohesion: steer to move towards the average position (center of mass) of
-// local flockmates
-void rule3(struct Boid *boids, int idx, struct Quadtree *q) {
-  boids[idx].headings[2] = boids[idx].currentHeading;
-
-  float sum_x_mass = 0;
-  float sum_y_mass = 0;
-  int n = 0;
-
-  int length;
-  int *nearby = quadtree_query(q, boids[idx].x - RADIUS_MAX / 2.0,
-                               boids[idx].y - RADIUS_MAX / 2.0, RADIUS_MAX,
-                               RADIUS_MAX, &length);
-
-  for (int j = 0; j < length; j++) {
-    int i = nearby[j];
-    if (i != idx) {
-      float dist = boid_dist(boids, idx, i);
-      if (dist < RADIUS_MAX) {
-        sum_x_mass += boids[i].x;
-        sum_y_mass += boids[i].y;
-        n++;
-      }
-    }
-  }
-
-  free(nearby);
-
-  if (n != 0) {
-    float dx = sum_x_mass / (float)n - boids[idx].x;
-    float dy = sum_y_mass / (float)n - boids[idx].y;
-    boids[idx].headings[2] = atan2(dy, dx);
-  }
-}
-
-// noise: steer in random directions
-void rule4(struct Boid *boids, int idx, struct Quadtree *q) {
-  boids[idx].headings[3] = boids[idx].currentHeading;
-
-  boids[idx].headings[3] += random_float(-0.1, 0.1);
-}
-
-void simulate_boids(struct Boid *boids, int num_boids, struct Widget *widgets,
-                    int num_widgets, struct Quadtree *q) {
-
-  for (int i = 0; i < num_boids; i++) {
-    boids[i].x += BOID_SPEED * cos(boids[i].currentHeading);
-    boids[i].y += BOID_SPEED * sin(boids[i].currentHeading);
-  }
-
-  for (int i = 0; i < num_boids; i++) {
-
-    if (boids[i].x > screen_size.width) {
-      boids[i].x = 0;
-    }
-    if (boids[i].x < 0) {
-      boids[i].x = screen_size.width;
-    }
-    if (boids[i].y > screen_size.height) {
-      boids[i].y = 0;
-    }
-    if (boids[i].y < 0) {
-      boids[i].y = screen_size.height;
-    }
-  }
-
-  for (int i = 0; i < num_boids; i++) {
-    rule1(boids, i, q);
-    rule2(boids, i, q);
-    rule3(boids, i, q);
-    rule4(boids, i, q);
-  }
-
-  for (int i = 0; i < num_boids; i++) {
-
-    float heading_weight = widgets[3].value_f;
-    float weights[] = {
-        widgets[2].value_f,
-        widgets[1].value_f,
-        widgets[0].value_f,
-        0.0,
-    };
-
-    float new_x = heading_weight * cos(boids[i].currentHeading) +
-                  weights[0] * cos(boids[i].headings[0]) +
-                  weights[1] * cos(boids[i].headings[1]) +
-                  weights[2] * cos(boids[i].headings[2]) +
-                  weights[3] * cos(boids[i].headings[3]);
-
-    float new_y = heading_weight * sin(boids[i].currentHeading) +
-                  weights[0] * sin(boids[i].headings[0]) +
-                  weights[1] * sin(boids[i].headings[1]) +
-                  weights[2] * sin(boids[i].headings[2]) +
-                  weights[3] * sin(boids[i].headings[3]);
-
-    boids[i].currentHeading = atan2(new_y, new_x);
-
-    boids[i].x += BOID_SPEED * cos(boids[i].currentHeading);
-    boids[i].y += BOID_SPEED * sin(boids[i].currentHeading);
-  }
-}
+#include <simulation.h>
+#include <simulation_thread.h>
+#include <snapshot.h>
+#include <spatial_index.h>
+#include <workers.h>
 
 int main(int argc, char *argv[]) {
-  int num_boids = 0;
-  struct Boid boids[MAX_BOIDS];
+  struct Flock flock;
+  flock_init(&flock, 0);
 
-  int num_widgets = 6;
+  int num_widgets = NUM_WIDGETS;
   struct Widget widgets[num_widgets];
-
-  // Typical values:
-  // Separation 0.04,
-  // Alignment  0.01,
-  // Cohesion   0.0025,
-  widgets[0].min = 0.0;
-  widgets[0].max = 0.005 * 4;
-  widgets[0].value_f = 0.0025;
-  widgets[0].type = WIDGET_SLIDER;
-  snprintf(widgets[0].name, 100, "Cohesion");
-
-  widgets[1].min = 0.0;
-  widgets[1].max = 0.02 * 4;
-  widgets[1].value_f = 0.01;
-  widgets[1].type = WIDGET_SLIDER;
-  snprintf(widgets[1].name, 100, "Alignment");
-
-  widgets[2].min = 0.0;
-  widgets[2].max = 0.08 * 4;
-  widgets[2].value_f = 0.04;
-  widgets[2].type = WIDGET_SLIDER;
-  snprintf(widgets[2].name, 100, "Separation");
-
-  widgets[3].min = 0.5;
-  widgets[3].max = 4.0;
-  widgets[3].value_f = 1.0;
-  widgets[3].type = WIDGET_SLIDER;
-  snprintf(widgets[3].name, 100, "Speed");
-
-  widgets[4].value_b = false;
-  widgets[4].type = WIDGET_CHECKBOX;
-  snprintf(widgets[4].name, 100, "Paused");
-
-  widgets[5].value_b = false;
-  widgets[5].type = WIDGET_CHECKBOX;
-  snprintf(widgets[5].name, 100, "Follow mode");
+  initialize_widgets(widgets);
 
   float fps = 0;
   int frame = 0;
   int target_fps = 0;
+  int rate = 60;
 
+  add_arg('a', "save", "Snapshot file S saves to (default boids.snapshot).");
   add_arg('c', "no-cap-framerate", "Start with a uncapped framerate.");
   add_arg('d', "debug", "Start with debug view enabled.");
+  add_arg('e', "replay", "Replay a recording instead of simulating.");
   add_arg('f', "fps", "Target FPS (default 60).");
+  add_arg('i', "index", "Spatial index: quadtree or grid (default quadtree).");
+  add_arg('l', "load", "Start from a snapshot file.");
   add_arg('n', "num", "Number of boids in simulation (default 256).");
+  add_arg('o', "profile", "Write per-phase timings to a CSV file.");
   add_arg('p', "pause", "Start paused.");
+  add_arg('q', "capacity", "Quadtree leaf capacity (default 32).");
+  add_arg('r', "rate", "Simulation steps per second (default 60).");
   add_arg('s', "seed", "Seed to use for random generation.");
+  add_arg('t', "threads", "Number of simulation threads (default all cores).");
   add_arg('u', "fullscreen", "Fullscreen mode.");
+  add_arg('w', "record", "Record every simulation step to a file.");
   add_arg('y', "dynamic",
           "Number of boids dynamically changes based on framerate.");
 
@@ -282,6 +67,18 @@ int main(int argc, char *argv[]) {
     target_fps = 60;
   }
 
+  if (get_is_set('r')) {
+    rate = atoi(get_value('r'));
+
+    if (rate < 1) {
+      rate = 1;
+    }
+  }
+
+  if (get_is_set('o')) {
+    profiler_open_csv(get_value('o'));
+  }
+
   int target_boids = 1000;
   if (get_is_set('n')) {
     target_boids = atoi(get_value('n'));
@@ -289,16 +86,37 @@ int main(int argc, char *argv[]) {
     if (target_boids < 0) {
       target_boids = 0;
     }
+  }
 
-    if (target_boids > MAX_BOIDS) {
-      target_boids = MAX_BOIDS;
+  struct SpatialIndex index = {0};
+  index.type = INDEX_QUADTREE;
+  if (get_is_set('i')) {
+    index.type = spatial_index_type(get_value('i'));
+
+    if (index.type == -1) {
+      fprintf(stderr, "Unknown spatial index: %s\n", get_value('i'));
+      exit(EXIT_FAILURE);
     }
   }
 
+  int leaf_capacity = QUADTREE_DEFAULT_CAPACITY;
+  if (get_is_set('q')) {
+    leaf_capacity = atoi(get_value('q'));
+  }
+  quadtree_configure(&index.quadtree, leaf_capacity, QUADTREE_DEFAULT_DEPTH);
+
+  int num_threads = workers_default_count();
+  if (get_is_set('t')) {
+    num_threads = atoi(get_value('t'));
+  }
+
+  struct Workers workers;
+  workers_init(&workers, num_threads);
+
   if (get_value('s')) {
-    srand(atoi(get_value('s')));
+    random_state.seed = atoi(get_value('s'));
   } else {
-    srand(time(0));
+    random_state.seed = time(0);
   }
 
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
@@ -306,24 +124,71 @@ int main(int argc, char *argv[]) {
 
   screen_size.width = 1200;
   screen_size.height = 700;
-  SDL_Window *window = SDL_CreateWindow("Boids", SDL_WINDOWPOS_UNDEFINED,
-                                        SDL_WINDOWPOS_UNDEFINED, screen_size.width, screen_size.height,
-                                        SDL_WINDOW_SHOWN);
+
+  // A snapshot brings its own world size, boids, widget values and random
+  // state, and the window opens at the size of its world.
+  bool loaded = get_is_set('l');
+  int first_frame = 0;
+  if (loaded) {
+    first_frame = snapshot_load(get_value('l'), &flock, widgets);
+    paused = paused || widgets[4].value_b;
+    widgets[4].value_b = paused;
+  }
+
+  // A replay draws recorded steps in place of the simulation, and plays them
+  // back at the simulation rate. Like a snapshot, it brings its own world
+  // size, which the window opens at.
+  bool replaying = get_is_set('e');
+  struct Replay replay;
+  struct Flock replay_flock;
+  double replay_cursor = 0;
+  int replay_decoded = -1;
+  int replay_frame = 0;
+
+  if (replaying) {
+    replay_open(&replay, get_value('e'));
+
+    if (replay.num_frames == 0) {
+      fprintf(stderr, "Empty recording: %s\n", get_value('e'));
+      exit(EXIT_FAILURE);
+    }
+
+    screen_size.width = replay.width;
+    screen_size.height = replay.height;
+    flock_init(&replay_flock, 0);
+  }
+
+  char *save_path = "boids.snapshot";
+  if (get_is_set('a')) {
+    save_path = get_value('a');
+  }
+
+  SDL_Window *window =
+      SDL_CreateWindow("Boids", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                       screen_size.width, screen_size.height, SDL_WINDOW_SHOWN);
 
   if (fullscreen) {
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
   }
 
-  SDL_GetWindowSize(window, &screen_size.width, &screen_size.height);
+  if (!loaded && !replaying) {
+    SDL_GetWindowSize(window, &screen_size.width, &screen_size.height);
+    initialize_positions(&flock, target_boids);
+  }
 
-  num_boids = initialize_positions(boids, target_boids);
+  bool recording = get_is_set('w') && !replaying;
+  struct Recorder recorder;
+  if (recording) {
+    recorder_open(&recorder, get_value('w'), screen_size.width,
+                  screen_size.height);
+  }
 
   SDL_Renderer *renderer =
       SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 
   TTF_Font *font = TTF_OpenFont("res/LiberationSans-Regular.ttf", 12);
 
-  SDL_Color white = {255, 255, 255};
+  SDL_Color white = {255, 255, 255, 255};
 
   int shade = 0x07;
   SDL_SetRenderDrawColor(renderer, shade, shade, shade, 0xff);
@@ -333,6 +198,37 @@ int main(int argc, char *argv[]) {
   int widget_selected = -1;
   bool lmb_down = false;
 
+  // From here on the flock belongs to the simulation thread, and the main
+  // thread draws the frames it hands over. The index drawn in the debug view
+  // is built here from those frames with a pool of just this thread.
+  struct SimulationThread sim;
+  if (!replaying) {
+    simulation_thread_start(&sim, &flock, index.type, leaf_capacity, &workers,
+                            recording ? &recorder : NULL, rate, first_frame,
+                            widgets, paused);
+  }
+
+  struct Workers render_workers;
+  workers_init(&render_workers, 1);
+
+  // Finds the boids in view when zoomed in. It is always a grid, which is the
+  // cheaper of the two to keep up to date from frame to frame.
+  struct SpatialIndex view_index = {0};
+  view_index.type = INDEX_GRID;
+
+  int shown_reorders = 0;
+
+  // The frame the indexes were last built from. They only change with the
+  // boids, so they are rebuilt when a new frame is shown rather than on every
+  // render.
+  struct Flock *indexed = NULL;
+  int indexed_frame = -1;
+  int indexed_count = -1;
+  bool index_current = false;
+  bool view_index_current = false;
+
+  Uint32 previous_begin = SDL_GetTicks();
+
   SDL_Event event;
   bool running = true;
   while (running) {
@@ -344,6 +240,11 @@ int main(int argc, char *argv[]) {
     int clicked_y = -1;
 
     Uint32 begin = SDL_GetTicks();
+    double elapsed = (begin - previous_begin) / 1000.0;
+    previous_begin = begin;
+
+    profiler_begin(PHASE_FRAME);
+    profiler_begin(PHASE_EVENTS);
 
     while (SDL_PollEvent(&event)) {
       switch (event.type) {
@@ -394,6 +295,29 @@ int main(int argc, char *argv[]) {
           widgets[4].value_b = paused;
           break;
 
+        // Saves the most recent completed step, along with the random state
+        // it was taken at.
+        case SDLK_s:
+          if (!replaying) {
+            struct SimulationFrame *latest = simulation_thread_acquire(&sim);
+            snapshot_save(save_path, &latest->flock, widgets,
+                          &latest->random_state, latest->frame);
+          }
+          break;
+
+        // Seeking in a replay, by a second or to the start.
+        case SDLK_LEFT:
+          replay_cursor -= rate;
+          break;
+
+        case SDLK_RIGHT:
+          replay_cursor += rate;
+          break;
+
+        case SDLK_HOME:
+          replay_cursor = 0;
+          break;
+
         default:
           // printf("Unhandled Key: %d\n", event.key.keysym.sym);
           break;
@@ -441,12 +365,50 @@ int main(int argc, char *argv[]) {
       paused = !paused;
     }
 
-    struct Quadtree q = {0};
-    q.w = screen_size.width;
-    q.h = screen_size.height;
+    if (!replaying) {
+      simulation_thread_set_controls(&sim, widgets, paused);
+    }
+    profiler_end(PHASE_EVENTS);
+
+    struct Flock *shown;
+    int shown_frame;
+    int followed = 0;
+    float alpha;
+
+    if (replaying) {
+      if (!paused) {
+        replay_cursor += elapsed * rate;
+      }
+
+      if (replay_cursor < 0) {
+        replay_cursor = 0;
+      }
+
+      if (replay_cursor > replay.num_frames - 1) {
+        replay_cursor = replay.num_frames - 1;
+      }
+
+      if ((int)replay_cursor != replay_decoded) {
+        replay_decoded = replay_cursor;
+        replay_frame = replay_read(&replay, replay_decoded, &replay_flock);
+      }
 
-    for (int i = 0; i < target_boids; i++) {
-      quadtree_insert(&q, i, boids[i].x, boids[i].y);
+      shown = &replay_flock;
+      shown_frame = replay_frame;
+      alpha = 1;
+    } else {
+      struct SimulationFrame *latest = simulation_thread_acquire(&sim);
+      shown = &latest->flock;
+      shown_frame = latest->frame;
+      followed = latest->followed;
+      alpha = simulation_thread_alpha(&sim, latest);
+
+      // Boids changed ids, so the grids cannot be updated incrementally.
+      if (latest->reorders != shown_reorders) {
+        shown_reorders = latest->reorders;
+        spatial_index_reset(&index);
+        spatial_index_reset(&view_index);
+      }
     }
 
     struct Context parent;
@@ -461,9 +423,12 @@ int main(int argc, char *argv[]) {
     child.w = screen_size.width;
     child.h = screen_size.height;
 
-    if (widgets[5].value_b && num_boids > 0) {
-      child.x = -boids[0].x + screen_size.width / 8;
-      child.y = -boids[0].y + screen_size.height / 8;
+    if (widgets[5].value_b && followed < shown->count) {
+      float x;
+      float y;
+      interpolate_position(shown, followed, alpha, &x, &y);
+      child.x = -x + screen_size.width / 8;
+      child.y = -y + screen_size.height / 8;
       child.w = screen_size.width / 4;
       child.h = screen_size.height / 4;
     } else if (lmb_down && widget_selected == -1) {
@@ -473,38 +438,77 @@ int main(int argc, char *argv[]) {
       child.h = screen_size.height / 4;
     }
 
-    render(renderer, window, boids, num_boids, widgets, num_widgets, parent,
-           child, frame, fps, white, &q, font, debug_view);
+    // A new frame from the simulation thread is always in a different buffer
+    // from the last one, and a replay shows a different frame number.
+    if (shown != indexed || shown_frame != indexed_frame ||
+        shown->count != indexed_count) {
+      indexed = shown;
+      indexed_frame = shown_frame;
+      indexed_count = shown->count;
+      index_current = false;
+      view_index_current = false;
+    }
+
+    // The index is only drawn in the debug view.
+    if (debug_view && !index_current) {
+      spatial_index_build(&index, shown->x, shown->y, shown->count,
+                          screen_size.width, screen_size.height, RADIUS_MAX,
+                          &render_workers);
+      index_current = true;
+    }
 
-    if (!paused) {
-      simulate_boids(boids, num_boids, widgets, num_widgets, &q);
-      frame++;
+    bool zoomed = child.w < parent.w;
+    if (zoomed && !view_index_current) {
+      spatial_index_build(&view_index, shown->x, shown->y, shown->count,
+                          screen_size.width, screen_size.height, RADIUS_MAX,
+                          &render_workers);
+      view_index_current = true;
     }
 
-    quadtree_free(&q);
+    render(renderer, window, shown, followed, widgets, num_widgets, parent,
+           child, shown_frame, fps, white, &index, zoomed ? &view_index : NULL,
+           font, debug_view, alpha);
+    frame++;
 
     Uint32 end = SDL_GetTicks();
     if (cap_framerate) {
       int delay = 1000 / target_fps - (end - begin);
       if (delay > 0) {
         SDL_Delay(delay);
-        if (dynamic) {
-          add_boid(boids, &num_boids);
+        if (dynamic && !replaying) {
+          simulation_thread_add_boids(&sim, 1);
         }
       } else {
-        if (dynamic) {
+        if (dynamic && !replaying) {
           if (frame % 100 == 0) {
-            remove_boid(&num_boids);
+            simulation_thread_add_boids(&sim, -1);
           }
         }
       }
     }
 
-    if (frame % 10 == 0) {
-      fps = 1000.0 / (SDL_GetTicks() - begin);
-    }
+    profiler_end(PHASE_FRAME);
+    fps = 1 / profiler_stats(PHASE_FRAME).avg;
+  }
+
+  if (replaying) {
+    replay_close(&replay);
+    flock_free(&replay_flock);
+    flock_free(&flock);
+  } else {
+    simulation_thread_stop(&sim);
   }
 
+  if (recording) {
+    recorder_close(&recorder);
+  }
+
+  profiler_close();
+  spatial_index_free(&index);
+  spatial_index_free(&view_index);
+  workers_free(&render_workers);
+  workers_free(&workers);
+
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
   SDL_Quit();
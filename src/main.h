@@ -1,6 +1,15 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#define BOID_SPEED .25
+#define RADIUS_MAX 20
+#define RADIUS_MIN 5
+#define NUM_WIDGETS 6
+
+// Longest frame the simulation catches up on, in seconds. Time beyond this is
+// dropped so a slow frame cannot snowball into ever more steps.
+#define MAX_FRAME_TIME 0.25
+
 enum {
   WIDGET_SLIDER,
   WIDGET_CHECKBOX,
@@ -9,8 +18,10 @@ enum {
 struct Boid {
   float x;
   float y;
-  float currentHeading;
-  float headings[4];
+  float vx;
+  float vy;
+  float steer_x[4];
+  float steer_y[4];
 };
 
 struct Widget {
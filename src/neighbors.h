@@ -0,0 +1,59 @@
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+#include <stdlib.h>
+
+// Caller-owned result buffer for spatial queries. It only grows, so after the
+// first few frames queries run without touching the allocator. Radius queries
+// also fill dx, dy and dist_2 with the offset to each neighbor and its square.
+struct Neighbors {
+  int *ids;
+  float *dx;
+  float *dy;
+  float *dist_2;
+  int length;
+  int capacity;
+};
+
+static inline void neighbors_grow(struct Neighbors *n) {
+  if (n->length == n->capacity) {
+    n->capacity = n->capacity ? n->capacity * 2 : 64;
+    n->ids = realloc(n->ids, sizeof(int) * n->capacity);
+    n->dx = realloc(n->dx, sizeof(float) * n->capacity);
+    n->dy = realloc(n->dy, sizeof(float) * n->capacity);
+    n->dist_2 = realloc(n->dist_2, sizeof(float) * n->capacity);
+  }
+}
+
+static inline void neighbors_push(struct Neighbors *n, int id) {
+  neighbors_grow(n);
+
+  n->ids[n->length] = id;
+  n->length++;
+}
+
+static inline void neighbors_push_near(struct Neighbors *n, int id, float dx,
+                                       float dy, float dist_2) {
+  neighbors_grow(n);
+
+  n->ids[n->length] = id;
+  n->dx[n->length] = dx;
+  n->dy[n->length] = dy;
+  n->dist_2[n->length] = dist_2;
+  n->length++;
+}
+
+static inline void neighbors_free(struct Neighbors *n) {
+  free(n->ids);
+  free(n->dx);
+  free(n->dy);
+  free(n->dist_2);
+  n->ids = NULL;
+  n->dx = NULL;
+  n->dy = NULL;
+  n->dist_2 = NULL;
+  n->length = 0;
+  n->capacity = 0;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <profiler.h>
+
+struct Profiler profiler = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+const char *phase_names[NUM_PHASES] = {
+    "frame", "events",    "render", "present",
+    "index", "move",      "rules",  "integrate",
+};
+
+// Seconds on the monotonic clock, used for all timing and pacing.
+double profiler_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Writes every sample from now on to path, one row per sample.
+void profiler_open_csv(const char *path) {
+  profiler.csv = fopen(path, "w");
+  if (!profiler.csv) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  profiler.start = profiler_now();
+  fprintf(profiler.csv, "time,phase,ms\n");
+}
+
+void profiler_begin(int phase) { profiler.begin[phase] = profiler_now(); }
+
+void profiler_end(int phase) {
+  profiler_record(phase, profiler_now() - profiler.begin[phase]);
+}
+
+void profiler_record(int phase, double seconds) {
+  pthread_mutex_lock(&profiler.mutex);
+
+  profiler.samples[phase][profiler.count[phase] % PROFILER_SAMPLES] = seconds;
+  profiler.count[phase]++;
+
+  if (profiler.csv) {
+    fprintf(profiler.csv, "%.6f,%s,%.6f\n", profiler_now() - profiler.start,
+            phase_names[phase], seconds * 1e3);
+  }
+
+  pthread_mutex_unlock(&profiler.mutex);
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Statistics over the most recent samples of phase, in seconds.
+struct PhaseStats profiler_stats(int phase) {
+  double samples[PROFILER_SAMPLES];
+
+  pthread_mutex_lock(&profiler.mutex);
+  int n = profiler.count[phase];
+  if (n > PROFILER_SAMPLES) {
+    n = PROFILER_SAMPLES;
+  }
+  memcpy(samples, profiler.samples[phase], sizeof(double) * n);
+  pthread_mutex_unlock(&profiler.mutex);
+
+  struct PhaseStats stats = {0};
+  if (n == 0) {
+    return stats;
+  }
+
+  qsort(samples, n, sizeof(double), compare_doubles);
+
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += samples[i];
+  }
+
+  stats.min = samples[0];
+  stats.avg = sum / n;
+  stats.p99 = samples[(n * 99 + 99) / 100 - 1];
+  return stats;
+}
+
+void profiler_close() {
+  if (profiler.csv) {
+    fclose(profiler.csv);
+    profiler.csv = NULL;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+// Number of most recent samples per phase the statistics are taken over.
+#define PROFILER_SAMPLES 256
+
+enum {
+  PHASE_FRAME,
+  PHASE_EVENTS,
+  PHASE_RENDER,
+  PHASE_PRESENT,
+  PHASE_INDEX_BUILD,
+  PHASE_MOVE,
+  PHASE_RULES,
+  PHASE_INTEGRATE,
+  NUM_PHASES,
+};
+
+// Rolling timings of each phase of a frame. The simulation phases are timed
+// on the simulation thread and the rest on the main thread, so recording and
+// reading take the mutex. Each phase is only timed on one thread at a time.
+struct Profiler {
+  pthread_mutex_t mutex;
+  double start;
+  double begin[NUM_PHASES];
+  double samples[NUM_PHASES][PROFILER_SAMPLES];
+  int count[NUM_PHASES];
+  FILE *csv;
+};
+
+struct PhaseStats {
+  double min;
+  double avg;
+  double p99;
+};
+
+extern struct Profiler profiler;
+
+extern const char *phase_names[NUM_PHASES];
+
+double profiler_now();
+
+void profiler_open_csv(const char *path);
+
+void profiler_begin(int phase);
+
+void profiler_end(int phase);
+
+void profiler_record(int phase, double seconds);
+
+struct PhaseStats profiler_stats(int phase);
+
+void profiler_close();
+
+#endif
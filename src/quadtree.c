@@ -5,147 +5,234 @@
 
 #include <quadtree.h>
 
-void quadtree_insert(struct Quadtree *q, int id, float x, float y) {
+// Returns the index of n new zeroed contiguous nodes. This may move the node
+// and point arrays, so callers must not hold pointers into them across it.
+int quadtree_alloc_nodes(struct Quadtree *q, int n) {
+  if (q->numNodes + n > q->capacity) {
+    q->capacity = q->capacity ? q->capacity * 2 : 256;
+    q->nodes = realloc(q->nodes, sizeof(struct QuadtreeNode) * q->capacity);
+  }
 
-  if (q->nw != NULL) {
-    // West
-    if (x < q->x + q->w / 2) {
-      // Northwest
-      if (y < q->y + q->h / 2) {
-        quadtree_insert(q->nw, id, x, y);
+  if (q->capacity * q->leafCapacity > q->pointCapacity) {
+    q->pointCapacity = q->capacity * q->leafCapacity;
+    q->points =
+        realloc(q->points, sizeof(struct QuadtreePoint) * q->pointCapacity);
+  }
 
-        // Southwest
-      } else {
-        quadtree_insert(q->sw, id, x, y);
-      }
+  int first = q->numNodes;
+  memset(&q->nodes[first], 0, sizeof(struct QuadtreeNode) * n);
+  q->numNodes += n;
 
-      // East
-    } else {
-      // Northeast
-      if (y < q->y + q->h / 2) {
-        quadtree_insert(q->ne, id, x, y);
+  return first;
+}
 
-        // Southeast
-      } else {
-        quadtree_insert(q->se, id, x, y);
-      }
+// Sets the leaf capacity, clamped to 1..QUADTREE_MAX_CAPACITY, and the depth
+// below which leaves no longer split. Takes effect from the next init.
+void quadtree_configure(struct Quadtree *q, int leaf_capacity, int max_depth) {
+  if (leaf_capacity < 1) {
+    leaf_capacity = 1;
+  }
+
+  if (leaf_capacity > QUADTREE_MAX_CAPACITY) {
+    leaf_capacity = QUADTREE_MAX_CAPACITY;
+  }
+
+  if (max_depth < 0) {
+    max_depth = 0;
+  }
+
+  q->leafCapacity = leaf_capacity;
+  q->maxDepth = max_depth;
+}
+
+// The leafCapacity point slots of a node.
+struct QuadtreePoint *quadtree_points(struct Quadtree *q, int node) {
+  return &q->points[node * q->leafCapacity];
+}
+
+// Starts a new tree covering w by h. Storage from previous frames is kept.
+void quadtree_init(struct Quadtree *q, float w, float h) {
+  if (q->leafCapacity == 0) {
+    quadtree_configure(q, QUADTREE_DEFAULT_CAPACITY, QUADTREE_DEFAULT_DEPTH);
+  }
+
+  q->numNodes = 0;
+  quadtree_alloc_nodes(q, 1);
+
+  q->nodes[0].w = w;
+  q->nodes[0].h = h;
+}
+
+void quadtree_insert_node(struct Quadtree *q, int node, int depth, int id,
+                          float x, float y) {
+  struct QuadtreeNode *n = &q->nodes[node];
+
+  while (n->children) {
+    int child = n->children;
+
+    // East
+    if (x >= n->x + n->w / 2) {
+      child += 1;
     }
-  } else {
 
-    if (q->numChildren < QUADTREE_MAX_CHILDREN) {
-      q->data[q->numChildren].id = id;
-      q->data[q->numChildren].x = x;
-      q->data[q->numChildren].y = y;
-      q->numChildren++;
-    } else {
+    // South
+    if (y >= n->y + n->h / 2) {
+      child += 2;
+    }
 
-      q->nw = malloc(sizeof(struct Quadtree));
-      q->ne = malloc(sizeof(struct Quadtree));
-      q->sw = malloc(sizeof(struct Quadtree));
-      q->se = malloc(sizeof(struct Quadtree));
-
-      memset(q->nw, 0, sizeof(struct Quadtree));
-      memset(q->ne, 0, sizeof(struct Quadtree));
-      memset(q->sw, 0, sizeof(struct Quadtree));
-      memset(q->se, 0, sizeof(struct Quadtree));
-
-      q->nw->x = q->x;
-      q->nw->y = q->y;
-      q->nw->w = q->w / 2;
-      q->nw->h = q->h / 2;
-
-      q->ne->x = q->x + q->w / 2;
-      q->ne->y = q->y;
-      q->ne->w = q->w / 2;
-      q->ne->h = q->h / 2;
-
-      q->sw->x = q->x;
-      q->sw->y = q->y + q->h / 2;
-      q->sw->w = q->w / 2;
-      q->sw->h = q->h / 2;
-
-      q->se->x = q->x + q->w / 2;
-      q->se->y = q->y + q->h / 2;
-      q->se->w = q->w / 2;
-      q->se->h = q->h / 2;
-
-      for (int i = 0; i < QUADTREE_MAX_CHILDREN; i++) {
-        q->data[i].id = 0;
-        q->data[i].x = 0;
-        q->data[i].y = 0;
-        quadtree_insert(q, q->data[i].id, q->data[i].x, q->data[i].y);
+    node = child;
+    n = &q->nodes[node];
+    depth++;
+  }
+
+  if (depth >= q->maxDepth) {
+    // Too deep to split, so the point goes in the first overflow node with
+    // room, adding one at the end of the chain if they are all full.
+    while (n->numChildren == q->leafCapacity) {
+      if (!n->overflow) {
+        int overflow = quadtree_alloc_nodes(q, 1);
+        n = &q->nodes[node];
+        n->overflow = overflow;
       }
-      q->numChildren = 0;
-      quadtree_insert(q, id, x, y);
+
+      node = n->overflow;
+      n = &q->nodes[node];
     }
   }
-}
 
-void quadtree_free(struct Quadtree *q) {
-  if (q->nw) {
-    quadtree_free(q->nw);
-    quadtree_free(q->ne);
-    quadtree_free(q->sw);
-    quadtree_free(q->se);
+  if (n->numChildren < q->leafCapacity) {
+    struct QuadtreePoint *p = &quadtree_points(q, node)[n->numChildren];
+    p->id = id;
+    p->x = x;
+    p->y = y;
+    n->numChildren++;
+    return;
+  }
+
+  // The leaf is full, so it splits and its points move down into the new
+  // children along with the new one.
+  struct QuadtreePoint points[QUADTREE_MAX_CAPACITY];
+  int num_points = n->numChildren;
+  memcpy(points, quadtree_points(q, node),
+         sizeof(struct QuadtreePoint) * num_points);
+
+  int children = quadtree_alloc_nodes(q, 4);
+  n = &q->nodes[node];
+  n->children = children;
+  n->numChildren = 0;
+
+  for (int i = 0; i < 4; i++) {
+    struct QuadtreeNode *c = &q->nodes[children + i];
+    c->x = n->x + (i % 2) * n->w / 2;
+    c->y = n->y + (i / 2) * n->h / 2;
+    c->w = n->w / 2;
+    c->h = n->h / 2;
+  }
 
-    free(q->nw);
-    free(q->ne);
-    free(q->sw);
-    free(q->se);
+  for (int i = 0; i < num_points; i++) {
+    quadtree_insert_node(q, node, depth, points[i].id, points[i].x,
+                         points[i].y);
   }
+  quadtree_insert_node(q, node, depth, id, x, y);
+}
+
+void quadtree_insert(struct Quadtree *q, int id, float x, float y) {
+  quadtree_insert_node(q, 0, 0, id, x, y);
+}
+
+// Drops every node in O(1), keeping the storage for the next frame.
+void quadtree_clear(struct Quadtree *q) { q->numNodes = 0; }
+
+void quadtree_free(struct Quadtree *q) {
+  free(q->nodes);
+  free(q->points);
+  memset(q, 0, sizeof(struct Quadtree));
 }
 
-bool rect_intersects(int x1, int y1, int w1, int h1, int x2, int y2, int w2,
-                     int h2) {
+bool rect_intersects(float x1, float y1, float w1, float h1, float x2,
+                     float y2, float w2, float h2) {
   return !(x1 + w1 < x2 || x2 + w2 < x1 || y1 + h1 < y2 || y2 + h2 < y1);
 }
 
-int *quadtree_query(struct Quadtree *q, int x, int y, int w, int h,
-                    int *length) {
-  if (rect_intersects(x, y, w, h, q->x, q->y, q->w, q->h)) {
-    if (q->nw) {
-      int r1len, r2len, r3len, r4len;
-      int *r1 = quadtree_query(q->nw, x, y, w, h, &r1len);
-      int *r2 = quadtree_query(q->ne, x, y, w, h, &r2len);
-      int *r3 = quadtree_query(q->sw, x, y, w, h, &r3len);
-      int *r4 = quadtree_query(q->se, x, y, w, h, &r4len);
-      *length = r1len + r2len + r3len + r4len;
-
-      int *ret = malloc(sizeof(int) * (*length));
-
-      int c = 0;
-      for (int i = 0; i < r1len; i++) {
-        ret[c] = r1[i];
-        c++;
-      }
-      for (int i = 0; i < r2len; i++) {
-        ret[c] = r2[i];
-        c++;
-      }
-      for (int i = 0; i < r3len; i++) {
-        ret[c] = r3[i];
-        c++;
-      }
-      for (int i = 0; i < r4len; i++) {
-        ret[c] = r4[i];
-        c++;
+// Leaves only report their points inside the box, so larger leaves do not
+// pass more candidates on to the caller.
+void quadtree_query_node(struct Quadtree *q, int node, int x, int y, int w,
+                         int h, struct Neighbors *result) {
+  struct QuadtreeNode *n = &q->nodes[node];
+
+  if (rect_intersects(x, y, w, h, n->x, n->y, n->w, n->h)) {
+    if (n->children) {
+      for (int i = 0; i < 4; i++) {
+        quadtree_query_node(q, n->children + i, x, y, w, h, result);
       }
+    } else {
+      do {
+        struct QuadtreePoint *points = quadtree_points(q, node);
+        for (int i = 0; i < q->nodes[node].numChildren; i++) {
+          struct QuadtreePoint *p = &points[i];
+          if (p->x >= x && p->x <= x + w && p->y >= y && p->y <= y + h) {
+            neighbors_push(result, p->id);
+          }
+        }
+        node = q->nodes[node].overflow;
+      } while (node);
+    }
+  }
+}
+
+void quadtree_query(struct Quadtree *q, int x, int y, int w, int h,
+                    struct Neighbors *result) {
+  if (q->numNodes > 0) {
+    quadtree_query_node(q, 0, x, y, w, h, result);
+  }
+}
 
-      free(r1);
-      free(r2);
-      free(r3);
-      free(r4);
+// Squared distance from (x, y) to the nearest point of a rectangle.
+float rect_dist_2(float x, float y, float rx, float ry, float rw, float rh) {
+  float dx = x < rx ? rx - x : x > rx + rw ? x - (rx + rw) : 0;
+  float dy = y < ry ? ry - y : y > ry + rh ? y - (ry + rh) : 0;
+  return dx * dx + dy * dy;
+}
 
-      return ret;
-    } else {
-      int *ret = malloc(sizeof(int));
-      ret[0] = q->data->id;
-      *length = 1;
-      return ret;
+// Skips every node that lies wholly outside the circle, not just outside its
+// bounding box.
+void quadtree_query_radius_node(struct Quadtree *q, const float *xs,
+                                const float *ys, int node, float x, float y,
+                                float radius_2, struct Neighbors *result) {
+  struct QuadtreeNode *n = &q->nodes[node];
+
+  if (rect_dist_2(x, y, n->x, n->y, n->w, n->h) > radius_2) {
+    return;
+  }
+
+  if (n->children) {
+    for (int i = 0; i < 4; i++) {
+      quadtree_query_radius_node(q, xs, ys, n->children + i, x, y, radius_2,
+                                 result);
     }
+  } else {
+    do {
+      struct QuadtreePoint *points = quadtree_points(q, node);
+      for (int i = 0; i < q->nodes[node].numChildren; i++) {
+        int id = points[i].id;
+        float dx = xs[id] - x;
+        float dy = ys[id] - y;
+        float dist_2 = dx * dx + dy * dy;
+        if (dist_2 < radius_2) {
+          neighbors_push_near(result, id, dx, dy, dist_2);
+        }
+      }
+      node = q->nodes[node].overflow;
+    } while (node);
   }
+}
 
-  int *ret = malloc(0);
-  *length = 0;
-  return ret;
+// Offsets are taken from xs and ys, the positions the caller reads, rather
+// than the copies made at insert time.
+void quadtree_query_radius(struct Quadtree *q, const float *xs,
+                           const float *ys, float x, float y, float radius,
+                           struct Neighbors *result) {
+  if (q->numNodes > 0) {
+    quadtree_query_radius_node(q, xs, ys, 0, x, y, radius * radius, result);
+  }
 }
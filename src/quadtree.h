@@ -1,7 +1,14 @@
 #ifndef QUADTREE_H
 #define QUADTREE_H
 
-#define QUADTREE_MAX_CHILDREN 1
+#include <neighbors.h>
+
+// Leaves hold up to leafCapacity points, which can be set at run time up to
+// QUADTREE_MAX_CAPACITY. Nodes at maxDepth no longer split, and chain overflow
+// nodes instead, so coincident points cannot recurse without bound.
+#define QUADTREE_MAX_CAPACITY 64
+#define QUADTREE_DEFAULT_CAPACITY 32
+#define QUADTREE_DEFAULT_DEPTH 16
 
 struct QuadtreePoint {
   float x;
@@ -9,26 +16,59 @@ struct QuadtreePoint {
   int id;
 };
 
-struct Quadtree {
+struct QuadtreeNode {
   float x;
   float y;
   float w;
   float h;
 
-  struct Quadtree *nw;
-  struct Quadtree *ne;
-  struct Quadtree *sw;
-  struct Quadtree *se;
+  // Index of the first of four sibling nodes in nw, ne, sw, se order, or 0 for
+  // a leaf. The root is node 0, so it is never anyone's child.
+  int children;
+
+  // Index of a node holding more points of this leaf, or 0. Only leaves at the
+  // maximum depth have one.
+  int overflow;
 
-  struct QuadtreePoint data[QUADTREE_MAX_CHILDREN];
+  // Points held in this node's slots of Quadtree.points.
   int numChildren;
 };
 
+// Nodes live in one array that is reused from frame to frame. Subdividing
+// takes four contiguous nodes from the end of the array, and clearing the tree
+// just drops them all, so memory stays flat once the array has grown.
+//
+// Points live in a parallel array with leafCapacity slots per node, so nodes
+// stay small and memory scales with the configured capacity.
+struct Quadtree {
+  struct QuadtreeNode *nodes;
+  int numNodes;
+  int capacity;
+
+  struct QuadtreePoint *points;
+  int pointCapacity;
+
+  int leafCapacity;
+  int maxDepth;
+};
+
+void quadtree_configure(struct Quadtree *q, int leaf_capacity, int max_depth);
+
+void quadtree_init(struct Quadtree *q, float w, float h);
+
 void quadtree_insert(struct Quadtree *q, int id, float x, float y);
 
+void quadtree_clear(struct Quadtree *q);
+
 void quadtree_free(struct Quadtree *q);
 
-int *quadtree_query(struct Quadtree *q, int x, int y, int w, int h,
-                    int *length);
+void quadtree_query(struct Quadtree *q, int x, int y, int w, int h,
+                    struct Neighbors *result);
+
+// Appends the points closer than radius to (x, y), with their offsets from it
+// computed from xs and ys.
+void quadtree_query_radius(struct Quadtree *q, const float *xs,
+                           const float *ys, float x, float y, float radius,
+                           struct Neighbors *result);
 
 #endif
@@ -0,0 +1,10 @@
+#include <random.h>
+
+// Fills out[i] with the value for counter first + i. The loop only does
+// integer multiplies, shifts and xors, so it vectorizes.
+void random_fill(float *out, int n, unsigned int key, unsigned int first,
+                 float low, float high) {
+  for (int i = 0; i < n; i++) {
+    out[i] = random_float_at(key, first + i, low, high);
+  }
+}
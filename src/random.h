@@ -0,0 +1,34 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+// Counter-based random numbers. Every value is a pure function of a key and a
+// counter, so values can be generated in any order, on any thread, and come
+// out the same for a given seed.
+
+// 32-bit integer hash with good avalanche (lowbias32 by Chris Wellons).
+static inline unsigned int random_hash(unsigned int x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// Key for one stream of values, e.g. one kind of value in one frame.
+static inline unsigned int random_key(unsigned int seed, unsigned int stream,
+                                      unsigned int step) {
+  return random_hash(seed ^ random_hash(stream ^ random_hash(step)));
+}
+
+// Uniform float in [low, high) for the given key and counter.
+static inline float random_float_at(unsigned int key, unsigned int counter,
+                                    float low, float high) {
+  unsigned int bits = random_hash(key ^ random_hash(counter));
+  return low + (high - low) * (float)(bits >> 8) * (1.0f / 16777216);
+}
+
+void random_fill(float *out, int n, unsigned int key, unsigned int first,
+                 float low, float high);
+
+#endif
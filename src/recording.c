@@ -0,0 +1,234 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <recording.h>
+
+// Both quantizers clamp and then round to nearest, so they round the same way.
+uint16_t recording_quantize_position(float x, float size) {
+  float q = x / size * 65535;
+  q = q < 0 ? 0 : q;
+  q = q > 65535 ? 65535 : q;
+  return lrintf(q);
+}
+
+int16_t recording_quantize_velocity(float v) {
+  float q = v * 32767;
+  q = q < -32767 ? -32767 : q;
+  q = q > 32767 ? 32767 : q;
+  return lrintf(q);
+}
+
+void *recorder_main(void *arg) {
+  struct Recorder *recorder = arg;
+
+  pthread_mutex_lock(&recorder->mutex);
+  while (true) {
+    while (recorder->running && recorder->tail == recorder->head) {
+      pthread_cond_wait(&recorder->ready, &recorder->mutex);
+    }
+
+    if (recorder->tail == recorder->head) {
+      break;
+    }
+
+    struct RecordingBuffer *buffer =
+        &recorder->buffers[recorder->tail % RECORDING_BUFFERS];
+    pthread_mutex_unlock(&recorder->mutex);
+
+    fwrite(buffer->data, 1, buffer->length, recorder->file);
+
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->tail++;
+  }
+  pthread_mutex_unlock(&recorder->mutex);
+
+  return NULL;
+}
+
+void recorder_open(struct Recorder *recorder, const char *path, float width,
+                   float height) {
+  *recorder = (struct Recorder){0};
+
+  recorder->file = fopen(path, "wb");
+  if (!recorder->file) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  recorder->width = width;
+  recorder->height = height;
+
+  struct RecordingHeader header = {0};
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  header.width = width;
+  header.height = height;
+  fwrite(&header, sizeof(header), 1, recorder->file);
+
+  pthread_mutex_init(&recorder->mutex, NULL);
+  pthread_cond_init(&recorder->ready, NULL);
+  recorder->running = true;
+  pthread_create(&recorder->thread, NULL, recorder_main, recorder);
+}
+
+// Encodes the flock as one chunk and queues it for writing. Never waits for
+// the disk.
+void recorder_write(struct Recorder *recorder, struct Flock *flock, int frame) {
+  pthread_mutex_lock(&recorder->mutex);
+  bool full = recorder->head - recorder->tail == RECORDING_BUFFERS;
+  if (full) {
+    recorder->dropped++;
+  }
+  pthread_mutex_unlock(&recorder->mutex);
+
+  if (full) {
+    return;
+  }
+
+  // The writer does not touch the head buffer until head moves past it.
+  struct RecordingBuffer *buffer =
+      &recorder->buffers[recorder->head % RECORDING_BUFFERS];
+
+  struct RecordingChunk chunk;
+  chunk.magic = RECORDING_CHUNK_MAGIC;
+  chunk.frame = frame;
+  chunk.count = flock->count;
+  chunk.size = sizeof(struct RecordedBoid) * flock->count;
+
+  buffer->length = sizeof(chunk) + chunk.size;
+  if (buffer->length > buffer->capacity) {
+    buffer->capacity = buffer->length * 2;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+
+  memcpy(buffer->data, &chunk, sizeof(chunk));
+  struct RecordedBoid *boids =
+      (struct RecordedBoid *)(buffer->data + sizeof(chunk));
+  for (int i = 0; i < flock->count; i++) {
+    boids[i].x = recording_quantize_position(flock->x[i], recorder->width);
+    boids[i].y = recording_quantize_position(flock->y[i], recorder->height);
+    boids[i].vx = recording_quantize_velocity(flock->vx[i]);
+    boids[i].vy = recording_quantize_velocity(flock->vy[i]);
+  }
+
+  pthread_mutex_lock(&recorder->mutex);
+  recorder->head++;
+  pthread_cond_signal(&recorder->ready);
+  pthread_mutex_unlock(&recorder->mutex);
+}
+
+// Writes out every queued step before closing.
+void recorder_close(struct Recorder *recorder) {
+  pthread_mutex_lock(&recorder->mutex);
+  recorder->running = false;
+  pthread_cond_signal(&recorder->ready);
+  pthread_mutex_unlock(&recorder->mutex);
+
+  pthread_join(recorder->thread, NULL);
+  pthread_mutex_destroy(&recorder->mutex);
+  pthread_cond_destroy(&recorder->ready);
+
+  fclose(recorder->file);
+  for (int i = 0; i < RECORDING_BUFFERS; i++) {
+    free(recorder->buffers[i].data);
+  }
+
+  if (recorder->dropped > 0) {
+    fprintf(stderr, "Recording dropped %d steps\n", recorder->dropped);
+  }
+}
+
+void replay_open(struct Replay *replay, const char *path) {
+  *replay = (struct Replay){0};
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  replay->size = st.st_size;
+
+  struct RecordingHeader header;
+  if (replay->size < sizeof(header)) {
+    fprintf(stderr, "Not a recording: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  replay->data = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (replay->data == MAP_FAILED) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  memcpy(&header, replay->data, sizeof(header));
+  if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RECORDING_VERSION) {
+    fprintf(stderr, "Not a recording: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  replay->width = header.width;
+  replay->height = header.height;
+
+  // Finds where each chunk starts, skipping over the boids, so any step can
+  // be found directly when seeking.
+  int capacity = 0;
+  size_t offset = sizeof(header);
+  while (offset + sizeof(struct RecordingChunk) <= replay->size) {
+    struct RecordingChunk chunk;
+    memcpy(&chunk, replay->data + offset, sizeof(chunk));
+
+    size_t end = offset + sizeof(chunk) + chunk.size;
+    if (chunk.magic != RECORDING_CHUNK_MAGIC || end > replay->size ||
+        chunk.size != sizeof(struct RecordedBoid) * chunk.count) {
+      break;
+    }
+
+    if (replay->num_frames == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      replay->offsets = realloc(replay->offsets, sizeof(size_t) * capacity);
+    }
+
+    replay->offsets[replay->num_frames] = offset;
+    replay->num_frames++;
+    offset = end;
+  }
+}
+
+// Decodes step i into flock and returns its frame number. The decoded boids
+// have no previous positions or rule outputs, so they are drawn as they are.
+int replay_read(struct Replay *replay, int i, struct Flock *flock) {
+  struct RecordingChunk chunk;
+  memcpy(&chunk, replay->data + replay->offsets[i], sizeof(chunk));
+
+  const struct RecordedBoid *boids =
+      (const struct RecordedBoid *)(replay->data + replay->offsets[i] +
+                                    sizeof(chunk));
+
+  flock_reserve(flock, chunk.count);
+  for (int j = 0; j < chunk.count; j++) {
+    flock->x[j] = boids[j].x * replay->width / 65535;
+    flock->y[j] = boids[j].y * replay->height / 65535;
+    flock->vx[j] = boids[j].vx / 32767.0f;
+    flock->vy[j] = boids[j].vy / 32767.0f;
+  }
+  flock->count = chunk.count;
+  flock_save_positions(flock);
+
+  return chunk.frame;
+}
+
+void replay_close(struct Replay *replay) {
+  munmap(replay->data, replay->size);
+  free(replay->offsets);
+  *replay = (struct Replay){0};
+}
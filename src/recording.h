@@ -0,0 +1,95 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <flock.h>
+
+#define RECORDING_MAGIC "BOIDREC1"
+#define RECORDING_VERSION 1
+#define RECORDING_CHUNK_MAGIC 0x4d415246
+#define RECORDING_BUFFERS 8
+
+// A recording is a RecordingHeader followed by one chunk per simulation step:
+// a RecordingChunk and then count RecordedBoids. Chunks are self-describing,
+// so a recording cut short still replays up to its last complete chunk.
+struct RecordingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  float width;
+  float height;
+};
+
+struct RecordingChunk {
+  uint32_t magic;
+  int32_t frame;
+  int32_t count;
+  uint32_t size;
+};
+
+// Positions are quantized to 1/65535 of the world and velocities to 1/32767,
+// which is 8 bytes per boid and well under a pixel at any window size.
+struct RecordedBoid {
+  uint16_t x;
+  uint16_t y;
+  int16_t vx;
+  int16_t vy;
+};
+
+struct RecordingBuffer {
+  char *data;
+  size_t length;
+  size_t capacity;
+};
+
+// Encodes steps on the simulation thread and writes them to disk from a
+// background thread. Encoded steps wait in a ring of buffers, and when the
+// disk falls so far behind that every buffer is waiting, steps are dropped
+// rather than holding up the simulation.
+struct Recorder {
+  FILE *file;
+  float width;
+  float height;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+  bool running;
+
+  struct RecordingBuffer buffers[RECORDING_BUFFERS];
+  int head;
+  int tail;
+  int dropped;
+};
+
+// A memory-mapped recording. Only the chunk headers are read when opening,
+// and each step is decoded straight from the mapping when asked for.
+struct Replay {
+  char *data;
+  size_t size;
+  float width;
+  float height;
+
+  size_t *offsets;
+  int num_frames;
+};
+
+void recorder_open(struct Recorder *recorder, const char *path, float width,
+                   float height);
+
+void recorder_write(struct Recorder *recorder, struct Flock *flock, int frame);
+
+void recorder_close(struct Recorder *recorder);
+
+void replay_open(struct Replay *replay, const char *path);
+
+int replay_read(struct Replay *replay, int i, struct Flock *flock);
+
+void replay_close(struct Replay *replay);
+
+#endif
@@ -1,7 +1,12 @@
 #include <SDL2/SDL2_gfxPrimitives.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <main.h>
+#include <profiler.h>
 #include <render.h>
+#include <simulation.h>
 
 void transform_to_context(struct Context *parent, struct Context *new, float *x,
                           float *y) {
@@ -16,143 +21,422 @@ void transform_to_context(struct Context *parent, struct Context *new, float *x,
   }
 }
 
+// Text drawn during a frame, from the atlas of the font it was drawn with.
+static struct GlyphAtlas text_atlas = {0};
+static struct Batch text_batch = {0};
+
+SDL_Vertex *batch_push(struct Batch *batch, int n) {
+  if (batch->length + n > batch->capacity) {
+    batch->capacity = batch->capacity ? batch->capacity * 2 : 1024;
+    batch->vertices =
+        realloc(batch->vertices, sizeof(SDL_Vertex) * batch->capacity);
+  }
+
+  SDL_Vertex *v = &batch->vertices[batch->length];
+  batch->length += n;
+  return v;
+}
+
+void batch_triangle(struct Batch *batch, float x1, float y1, float x2,
+                    float y2, float x3, float y3, SDL_Color color) {
+  SDL_Vertex *v = batch_push(batch, 3);
+  v[0] = (SDL_Vertex){{x1, y1}, color, {0, 0}};
+  v[1] = (SDL_Vertex){{x2, y2}, color, {0, 0}};
+  v[2] = (SDL_Vertex){{x3, y3}, color, {0, 0}};
+}
+
+void batch_rect(struct Batch *batch, float x1, float y1, float x2, float y2,
+                SDL_Color color) {
+  batch_triangle(batch, x1, y1, x2, y1, x2, y2, color);
+  batch_triangle(batch, x1, y1, x2, y2, x1, y2, color);
+}
+
+// Copies src of a texture_w by texture_h texture to dst, tinted by color.
+void batch_textured_rect(struct Batch *batch, SDL_Rect dst, SDL_Rect src,
+                         int texture_w, int texture_h, SDL_Color color) {
+  float x1 = dst.x;
+  float y1 = dst.y;
+  float x2 = dst.x + dst.w;
+  float y2 = dst.y + dst.h;
+
+  float u1 = (float)src.x / texture_w;
+  float v1 = (float)src.y / texture_h;
+  float u2 = (float)(src.x + src.w) / texture_w;
+  float v2 = (float)(src.y + src.h) / texture_h;
+
+  SDL_Vertex *v = batch_push(batch, 6);
+  v[0] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+  v[1] = (SDL_Vertex){{x2, y1}, color, {u2, v1}};
+  v[2] = (SDL_Vertex){{x2, y2}, color, {u2, v2}};
+  v[3] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+  v[4] = (SDL_Vertex){{x2, y2}, color, {u2, v2}};
+  v[5] = (SDL_Vertex){{x1, y2}, color, {u1, v2}};
+}
+
+// Draws everything batched so far and empties the batch. texture may be NULL
+// for solid colors.
+void batch_draw(SDL_Renderer *renderer, struct Batch *batch,
+                SDL_Texture *texture) {
+  if (batch->length > 0) {
+    SDL_RenderGeometry(renderer, texture, batch->vertices, batch->length, NULL,
+                       0);
+  }
+  batch->length = 0;
+}
+
+// Renders each glyph once and packs them side by side into one texture.
+void glyph_atlas_init(struct GlyphAtlas *atlas, SDL_Renderer *renderer,
+                      TTF_Font *font) {
+  SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+  SDL_Surface *surfaces[GLYPH_LAST - GLYPH_FIRST + 1];
+
+  atlas->font = font;
+  atlas->w = 0;
+  atlas->h = 0;
+
+  for (int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+    int i = c - GLYPH_FIRST;
+    surfaces[i] = TTF_RenderGlyph_Solid(font, c, white);
+    TTF_GlyphMetrics(font, c, NULL, NULL, NULL, NULL, &atlas->advances[i]);
+
+    atlas->glyphs[i].x = atlas->w;
+    atlas->glyphs[i].y = 0;
+    atlas->glyphs[i].w = surfaces[i] ? surfaces[i]->w : 0;
+    atlas->glyphs[i].h = surfaces[i] ? surfaces[i]->h : 0;
+
+    atlas->w += atlas->glyphs[i].w;
+    if (atlas->glyphs[i].h > atlas->h) {
+      atlas->h = atlas->glyphs[i].h;
+    }
+  }
+
+  // New surfaces start out transparent, and the glyph background is a color
+  // key, so only the glyphs themselves are copied.
+  SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
+      0, atlas->w, atlas->h, 32, SDL_PIXELFORMAT_RGBA32);
+  for (int i = 0; i <= GLYPH_LAST - GLYPH_FIRST; i++) {
+    if (surfaces[i]) {
+      SDL_BlitSurface(surfaces[i], NULL, surface, &atlas->glyphs[i]);
+      SDL_FreeSurface(surfaces[i]);
+    }
+  }
+
+  atlas->texture = SDL_CreateTextureFromSurface(renderer, surface);
+  SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+  SDL_FreeSurface(surface);
+}
+
+void glyph_atlas_free(struct GlyphAtlas *atlas) {
+  if (atlas->texture) {
+    SDL_DestroyTexture(atlas->texture);
+  }
+  *atlas = (struct GlyphAtlas){0};
+}
+
+// Queues text to be drawn from the glyph atlas of the font by flush_text.
+// Characters outside printable ASCII are skipped.
 void draw_text(SDL_Renderer *renderer, TTF_Font *font, int x, int y,
                SDL_Color color, char *text) {
-  SDL_Surface *textSurface = TTF_RenderText_Solid(font, text, color);
-  SDL_Texture *textTexture =
-      SDL_CreateTextureFromSurface(renderer, textSurface);
-  SDL_Rect rect = textSurface->clip_rect;
-  rect.x = x;
-  rect.y = y;
-  SDL_RenderCopy(renderer, textTexture, NULL, &rect);
-  SDL_FreeSurface(textSurface);
-  SDL_DestroyTexture(textTexture);
+  if (text_atlas.font != font) {
+    flush_text(renderer);
+    glyph_atlas_free(&text_atlas);
+    glyph_atlas_init(&text_atlas, renderer, font);
+  }
+
+  for (char *c = text; *c; c++) {
+    if (*c < GLYPH_FIRST || *c > GLYPH_LAST) {
+      continue;
+    }
+
+    int i = *c - GLYPH_FIRST;
+    SDL_Rect dst = text_atlas.glyphs[i];
+    dst.x = x;
+    dst.y = y;
+    batch_textured_rect(&text_batch, dst, text_atlas.glyphs[i], text_atlas.w,
+                        text_atlas.h, color);
+    x += text_atlas.advances[i];
+  }
 }
 
-void draw_quadtree(SDL_Renderer *renderer, struct Quadtree *q,
+// Draws all queued text with one call.
+void flush_text(SDL_Renderer *renderer) {
+  batch_draw(renderer, &text_batch, text_atlas.texture);
+}
+
+// The part of the world shown when drawing child into parent, which is
+// x1 <= x < x2 and y1 <= y < y2 in world coordinates.
+void visible_region(struct Context *parent, struct Context *child, float *x1,
+                    float *y1, float *x2, float *y2) {
+  *x1 = parent->x - child->x;
+  *y1 = parent->y - child->y;
+  *x2 = *x1 + child->w;
+  *y2 = *y1 + child->h;
+}
+
+void draw_quadtree(struct Batch *batch, struct Quadtree *q, int node,
                    struct Context parent, struct Context child, int shade,
                    int shade_increment) {
+  struct QuadtreeNode *n = &q->nodes[node];
+
+  // Nodes out of view are skipped along with all of their children.
+  float view_x1, view_y1, view_x2, view_y2;
+  visible_region(&parent, &child, &view_x1, &view_y1, &view_x2, &view_y2);
+  if (n->x >= view_x2 || n->y >= view_y2 || n->x + n->w <= view_x1 ||
+      n->y + n->h <= view_y1) {
+    return;
+  }
 
-  float x1 = q->x;
-  float y1 = q->y;
-  float x2 = q->x + q->w;
-  float y2 = q->y + q->h;
+  float x1 = n->x;
+  float y1 = n->y;
+  float x2 = n->x + n->w;
+  float y2 = n->y + n->h;
 
   transform_to_context(&parent, &child, &x1, &y1);
   transform_to_context(&parent, &child, &x2, &y2);
 
-  SDL_Rect rect;
-  rect.x = x1;
-  rect.y = y1;
-  rect.w = x2 - x1;
-  rect.h = y2 - y1;
-
-  SDL_SetRenderDrawColor(renderer, shade, shade, shade, 0xff);
-  SDL_RenderFillRect(renderer, &rect);
+  SDL_Color color = {shade, shade, shade, 0xff};
+  batch_rect(batch, x1, y1, x2, y2, color);
   shade -= shade_increment;
   if (shade < 0) {
     shade = 0;
   }
 
-  if (q->nw) {
-    draw_quadtree(renderer, q->nw, parent, child, shade, shade_increment);
+  if (n->children) {
+    for (int i = 0; i < 4; i++) {
+      draw_quadtree(batch, q, n->children + i, parent, child, shade,
+                    shade_increment);
+    }
   }
+}
 
-  if (q->ne) {
-    draw_quadtree(renderer, q->ne, parent, child, shade, shade_increment);
-  }
+void draw_grid(struct Batch *batch, struct Grid *g, struct Context parent,
+               struct Context child, int shade, int shade_increment) {
+  float view_x1, view_y1, view_x2, view_y2;
+  visible_region(&parent, &child, &view_x1, &view_y1, &view_x2, &view_y2);
 
-  if (q->sw) {
-    draw_quadtree(renderer, q->sw, parent, child, shade, shade_increment);
-  }
+  int min_cx = fmaxf(view_x1 / g->cell_size, 0);
+  int min_cy = fmaxf(view_y1 / g->cell_size, 0);
+  int max_cx = fminf(view_x2 / g->cell_size, g->cols - 1);
+  int max_cy = fminf(view_y2 / g->cell_size, g->rows - 1);
 
-  if (q->se) {
-    draw_quadtree(renderer, q->se, parent, child, shade, shade_increment);
+  for (int cy = min_cy; cy <= max_cy; cy++) {
+    for (int cx = min_cx; cx <= max_cx; cx++) {
+      int c = cy * g->cols + cx;
+      int count = g->cellCount[c];
+
+      float x1 = cx * g->cell_size;
+      float y1 = cy * g->cell_size;
+      float x2 = x1 + g->cell_size;
+      float y2 = y1 + g->cell_size;
+
+      transform_to_context(&parent, &child, &x1, &y1);
+      transform_to_context(&parent, &child, &x2, &y2);
+
+      int cell_shade = shade - shade_increment * count;
+      if (cell_shade < 0) {
+        cell_shade = 0;
+      }
+
+      SDL_Color color = {cell_shade, cell_shade, cell_shade, 0xff};
+      batch_rect(batch, x1, y1, x2, y2, color);
+    }
   }
 }
 
-void draw_boid(SDL_Renderer *renderer, struct Boid *boid, struct Context parent,
+void draw_boid(struct Batch *batch, struct Boid *boid, struct Context parent,
                struct Context child, int id) {
   float cx = boid->x;
   float cy = boid->y;
 
-  float currentHeading = boid->currentHeading;
+  // The velocity is a unit vector, and (-vy, vx) is it turned a quarter turn.
+  float vx = boid->vx;
+  float vy = boid->vy;
 
-  float x1 = cx + BOID_LENGTH * cos(currentHeading);
-  float y1 = cy + BOID_LENGTH * sin(currentHeading);
+  float x1 = cx + BOID_LENGTH * vx;
+  float y1 = cy + BOID_LENGTH * vy;
 
-  float x2 = cx + BOID_LENGTH * cos(currentHeading + M_PI / 2) * 0.25;
-  float y2 = cy + BOID_LENGTH * sin(currentHeading + M_PI / 2) * 0.25;
+  float x2 = cx - BOID_LENGTH * vy * 0.25;
+  float y2 = cy + BOID_LENGTH * vx * 0.25;
 
-  float x3 = cx + BOID_LENGTH * cos(currentHeading - M_PI / 2) * 0.25;
-  float y3 = cy + BOID_LENGTH * sin(currentHeading - M_PI / 2) * 0.25;
+  float x3 = cx + BOID_LENGTH * vy * 0.25;
+  float y3 = cy - BOID_LENGTH * vx * 0.25;
 
   transform_to_context(&parent, &child, &x1, &y1);
   transform_to_context(&parent, &child, &x2, &y2);
   transform_to_context(&parent, &child, &x3, &y3);
 
-  filledTrigonRGBA(renderer, x1, y1, x2, y2, x3, y3, BOID_SHADE, BOID_SHADE,
-                   BOID_SHADE, 0xff);
+  SDL_Color color = {BOID_SHADE, BOID_SHADE, BOID_SHADE, 0xff};
+  batch_triangle(batch, x1, y1, x2, y2, x3, y3, color);
 }
 
-void draw_boids(SDL_Renderer *renderer, struct Boid boids[], int num_boids,
-                struct Context parent, struct Context child, bool debug_view,
-                struct Quadtree *q) {
+// Counts the given boids, or the first count boids when ids is NULL, into
+// blocks of the screen and draws the counts as one texture, more opaque where
+// more boids overlap.
+void draw_density(SDL_Renderer *renderer, struct DensityMap *map,
+                  struct Flock *flock, int *ids, int count,
+                  struct Context parent, struct Context child, float alpha) {
+  int w = (parent.w + DENSITY_SCALE - 1) / DENSITY_SCALE;
+  int h = (parent.h + DENSITY_SCALE - 1) / DENSITY_SCALE;
+
+  if (map->w != w || map->h != h) {
+    if (map->texture) {
+      SDL_DestroyTexture(map->texture);
+    }
+
+    map->w = w;
+    map->h = h;
+    map->counts = realloc(map->counts, sizeof(unsigned int) * w * h);
+    map->pixels = realloc(map->pixels, sizeof(Uint32) * w * h);
+    map->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING, w, h);
+    SDL_SetTextureBlendMode(map->texture, SDL_BLENDMODE_BLEND);
+  }
+
+  memset(map->counts, 0, sizeof(unsigned int) * w * h);
+
+  for (int j = 0; j < count; j++) {
+    int i = ids ? ids[j] : j;
+
+    float x;
+    float y;
+    interpolate_position(flock, i, alpha, &x, &y);
+    transform_to_context(&parent, &child, &x, &y);
+
+    int cx = (x - parent.x) / DENSITY_SCALE;
+    int cy = (y - parent.y) / DENSITY_SCALE;
+    if (cx >= 0 && cy >= 0 && cx < w && cy < h) {
+      map->counts[cy * w + cx]++;
+    }
+  }
+
+  Uint32 rgb = BOID_SHADE << 16 | BOID_SHADE << 8 | BOID_SHADE;
+  for (int c = 0; c < w * h; c++) {
+    unsigned int a = map->counts[c] * DENSITY_ALPHA_INCREMENT;
+    if (a > 0xff) {
+      a = 0xff;
+    }
+    map->pixels[c] = a << 24 | rgb;
+  }
+
+  SDL_UpdateTexture(map->texture, NULL, map->pixels, sizeof(Uint32) * w);
+
+  SDL_Rect rect = {parent.x, parent.y, w * DENSITY_SCALE, h * DENSITY_SCALE};
+  SDL_RenderCopy(renderer, map->texture, NULL, &rect);
+}
+
+// The index and the boids are drawn before the debug overlay for the followed
+// boid so the overlay stays on top.
+//
+// When zoomed in, only the boids view_index finds in view are drawn. It may be
+// NULL, in which case every boid is drawn.
+void draw_boids(SDL_Renderer *renderer, struct Batch *batch,
+                struct Flock *flock, int followed, struct Context parent,
+                struct Context child, bool debug_view,
+                struct SpatialIndex *index, struct SpatialIndex *view_index,
+                float alpha) {
+  static struct Neighbors visible = {0};
+  bool culled = view_index && child.w < parent.w;
+
+  if (culled) {
+    // Widened by the size of a boid and how far it can be drawn from its
+    // indexed position, and kept inside the world so the query does not wrap.
+    float view_x1, view_y1, view_x2, view_y2;
+    visible_region(&parent, &child, &view_x1, &view_y1, &view_x2, &view_y2);
+
+    float margin = BOID_LENGTH + 2 * BOID_SPEED;
+    int x1 = fmaxf(floorf(view_x1 - margin), 0);
+    int y1 = fmaxf(floorf(view_y1 - margin), 0);
+    int x2 = fminf(ceilf(view_x2 + margin), view_index->w);
+    int y2 = fminf(ceilf(view_y2 + margin), view_index->h);
+
+    visible.length = 0;
+    if (x2 > x1 && y2 > y1) {
+      spatial_index_query(view_index, x1, y1, x2 - x1, y2 - y1, &visible);
+    }
+  }
+
   if (debug_view) {
-    SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
-    draw_quadtree(renderer, q, parent, child, QUADTREE_STARTING_SHADE,
-                  QUADTREE_SHADE_INCREMENT);
+    if (index->type == INDEX_GRID) {
+      draw_grid(batch, &index->grid, parent, child, QUADTREE_STARTING_SHADE,
+                QUADTREE_SHADE_INCREMENT);
+    } else {
+      draw_quadtree(batch, &index->quadtree, 0, parent, child,
+                    QUADTREE_STARTING_SHADE, QUADTREE_SHADE_INCREMENT);
+    }
   }
 
-  for (int i = 0; i < num_boids; i++) {
-    draw_boid(renderer, &boids[i], parent, child, i);
+  int count = culled ? visible.length : flock->count;
+  int *ids = culled ? visible.ids : NULL;
 
-    if (i == 0 && debug_view == true && num_boids > 0) {
-      float x = boids[i].x;
-      float y = boids[i].y;
-      transform_to_context(&parent, &child, &x, &y);
+  // Past LOD_BOIDS_PER_PIXEL the boids in view overlap so much that drawing
+  // them one by one shows no more than their density does. Zooming in spreads
+  // them over more pixels, so individual boids come back.
+  if (count > LOD_BOIDS_PER_PIXEL * parent.w * parent.h) {
+    static struct DensityMap density = {0};
+    batch_draw(renderer, batch, NULL);
+    draw_density(renderer, &density, flock, ids, count, parent, child, alpha);
+  } else {
+    for (int j = 0; j < count; j++) {
+      int i = ids ? ids[j] : j;
 
-      float scale = parent.w / child.w;
+      struct Boid boid;
+      flock_get(flock, i, &boid);
+      interpolate_position(flock, i, alpha, &boid.x, &boid.y);
+      draw_boid(batch, &boid, parent, child, i);
+    }
 
-      aacircleRGBA(renderer, x, y, scale * RADIUS_MAX, 0xff, 0xff, 0xff, 0xff);
-      aacircleRGBA(renderer, x, y, scale * RADIUS_MIN, 0xff, 0xff, 0xff, 0xff);
+    batch_draw(renderer, batch, NULL);
+  }
 
-      int ind_len = 10;
-      {
-        float x1 = boids[i].x;
-        float y1 = boids[i].y;
-        float x2 = x1 + ind_len * cos(boids[i].headings[0]);
-        float y2 = y1 + ind_len * sin(boids[i].headings[0]);
+  if (debug_view && followed < flock->count) {
+    struct Boid boid;
+    flock_get(flock, followed, &boid);
+    interpolate_position(flock, followed, alpha, &boid.x, &boid.y);
 
-        transform_to_context(&parent, &child, &x1, &y1);
-        transform_to_context(&parent, &child, &x2, &y2);
-        SDL_SetRenderDrawColor(renderer, 0xff, 0, 0, 0xff);
-        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
-      }
+    float x = boid.x;
+    float y = boid.y;
+    transform_to_context(&parent, &child, &x, &y);
 
-      {
-        float x1 = boids[i].x;
-        float y1 = boids[i].y;
-        float x2 = x1 + ind_len * cos(boids[i].headings[1]);
-        float y2 = y1 + ind_len * sin(boids[i].headings[1]);
+    float scale = parent.w / child.w;
 
-        transform_to_context(&parent, &child, &x1, &y1);
-        transform_to_context(&parent, &child, &x2, &y2);
-        SDL_SetRenderDrawColor(renderer, 0, 0xff, 0, 0xff);
-        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
-      }
+    aacircleRGBA(renderer, x, y, scale * RADIUS_MAX, 0xff, 0xff, 0xff, 0xff);
+    aacircleRGBA(renderer, x, y, scale * RADIUS_MIN, 0xff, 0xff, 0xff, 0xff);
 
-      {
-        float x1 = boids[i].x;
-        float y1 = boids[i].y;
-        float x2 = x1 + ind_len * cos(boids[i].headings[2]);
-        float y2 = y1 + ind_len * sin(boids[i].headings[2]);
+    int ind_len = 10;
+    {
+      float x1 = boid.x;
+      float y1 = boid.y;
+      float x2 = x1 + ind_len * boid.steer_x[0];
+      float y2 = y1 + ind_len * boid.steer_y[0];
 
-        transform_to_context(&parent, &child, &x1, &y1);
-        transform_to_context(&parent, &child, &x2, &y2);
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0xff, 0xff);
-        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
-      }
+      transform_to_context(&parent, &child, &x1, &y1);
+      transform_to_context(&parent, &child, &x2, &y2);
+      SDL_SetRenderDrawColor(renderer, 0xff, 0, 0, 0xff);
+      SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+    }
+
+    {
+      float x1 = boid.x;
+      float y1 = boid.y;
+      float x2 = x1 + ind_len * boid.steer_x[1];
+      float y2 = y1 + ind_len * boid.steer_y[1];
+
+      transform_to_context(&parent, &child, &x1, &y1);
+      transform_to_context(&parent, &child, &x2, &y2);
+      SDL_SetRenderDrawColor(renderer, 0, 0xff, 0, 0xff);
+      SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+    }
+
+    {
+      float x1 = boid.x;
+      float y1 = boid.y;
+      float x2 = x1 + ind_len * boid.steer_x[2];
+      float y2 = y1 + ind_len * boid.steer_y[2];
+
+      transform_to_context(&parent, &child, &x1, &y1);
+      transform_to_context(&parent, &child, &x2, &y2);
+      SDL_SetRenderDrawColor(renderer, 0, 0, 0xff, 0xff);
+      SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
     }
   }
 }
@@ -281,11 +565,28 @@ void draw_slider(SDL_Renderer *renderer, TTF_Font *font, int w, int h,
   draw_text(renderer, font, 225, h - padding - height / 2 - 6, white, buf);
 }
 
-void render(SDL_Renderer *renderer, SDL_Window *window, struct Boid *boids,
-            int num_boids, struct Widget *widgets, int num_widgets,
+// Rolling min, average and 99th percentile of each phase, in milliseconds.
+void draw_profiler(SDL_Renderer *renderer, TTF_Font *font, int x, int y,
+                   SDL_Color color) {
+  char text[256];
+  snprintf(text, 255, "%-10s %8s %8s %8s", "phase (ms)", "min", "avg", "p99");
+  draw_text(renderer, font, x, y, color, text);
+
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    struct PhaseStats stats = profiler_stats(phase);
+    snprintf(text, 255, "%-10s %8.3f %8.3f %8.3f", phase_names[phase],
+             stats.min * 1e3, stats.avg * 1e3, stats.p99 * 1e3);
+    draw_text(renderer, font, x, y + 16 * (phase + 1), color, text);
+  }
+}
+
+void render(SDL_Renderer *renderer, SDL_Window *window, struct Flock *flock,
+            int followed, struct Widget *widgets, int num_widgets,
             struct Context parent, struct Context child, int frame, int fps,
-            SDL_Color white, struct Quadtree *q, TTF_Font *font,
-            bool debug_view) {
+            SDL_Color white, struct SpatialIndex *index,
+            struct SpatialIndex *view_index, TTF_Font *font, bool debug_view,
+            float alpha) {
+  profiler_begin(PHASE_RENDER);
 
   int w;
   int h;
@@ -295,7 +596,9 @@ void render(SDL_Renderer *renderer, SDL_Window *window, struct Boid *boids,
   SDL_SetRenderDrawColor(renderer, shade, shade, shade, 0xff);
   SDL_RenderClear(renderer);
 
-  draw_boids(renderer, boids, num_boids, parent, child, debug_view, q);
+  static struct Batch batch = {0};
+  draw_boids(renderer, &batch, flock, followed, parent, child, debug_view,
+             index, view_index, alpha);
 
   char frame_text[256];
   snprintf(frame_text, 255, "Frame: %d", frame);
@@ -306,9 +609,13 @@ void render(SDL_Renderer *renderer, SDL_Window *window, struct Boid *boids,
   draw_text(renderer, font, 5, 16 + 5, white, framerate_text);
 
   char num_boids_text[256];
-  snprintf(num_boids_text, 255, "Boids: %d", (int)num_boids);
+  snprintf(num_boids_text, 255, "Boids: %d", flock->count);
   draw_text(renderer, font, 5, 32 + 5, white, num_boids_text);
 
+  if (debug_view) {
+    draw_profiler(renderer, font, 5, 48 + 5, white);
+  }
+
   for (int i = 0; i < num_widgets; i++) {
     if (widgets[i].type == WIDGET_SLIDER) {
       draw_slider(renderer, font, w, h - 30 * i, &widgets[i]);
@@ -317,5 +624,10 @@ void render(SDL_Renderer *renderer, SDL_Window *window, struct Boid *boids,
     }
   }
 
+  flush_text(renderer);
+  profiler_end(PHASE_RENDER);
+
+  profiler_begin(PHASE_PRESENT);
   SDL_RenderPresent(renderer);
+  profiler_end(PHASE_PRESENT);
 }
@@ -4,17 +4,19 @@
 #include <SDL2/SDL_ttf.h>
 #include <stdbool.h>
 
+#include <flock.h>
 #include <main.h>
-#include <quadtree.h>
+#include <spatial_index.h>
 
 #define BOID_LENGTH 4
-#define BOID_SPEED .25
-#define MAX_BOIDS 10000
-#define RADIUS_MAX 20
-#define RADIUS_MIN 5
 #define BOID_SHADE 0x9f
 #define QUADTREE_STARTING_SHADE 0x40
 #define QUADTREE_SHADE_INCREMENT 0x4
+#define DENSITY_SCALE 2
+#define DENSITY_ALPHA_INCREMENT 0x30
+#define LOD_BOIDS_PER_PIXEL 0.1
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
 
 struct Context {
   float x;
@@ -23,24 +25,83 @@ struct Context {
   float h;
 };
 
-void render(SDL_Renderer *renderer, SDL_Window *window, struct Boid *boids,
-            int num_boids, struct Widget *widgets, int num_widgets,
+// Solid triangles collected over a frame and drawn with one
+// SDL_RenderGeometry call, in the order they were added.
+struct Batch {
+  SDL_Vertex *vertices;
+  int length;
+  int capacity;
+};
+
+// Boids per DENSITY_SCALE square block of screen pixels, drawn as one texture
+// in place of the individual boids when they are packed too densely to tell
+// apart.
+struct DensityMap {
+  SDL_Texture *texture;
+  int w;
+  int h;
+  unsigned int *counts;
+  Uint32 *pixels;
+};
+
+// The printable ASCII glyphs of a font, rendered once into one white texture
+// that text is drawn from in any color.
+struct GlyphAtlas {
+  TTF_Font *font;
+  SDL_Texture *texture;
+  int w;
+  int h;
+  SDL_Rect glyphs[GLYPH_LAST - GLYPH_FIRST + 1];
+  int advances[GLYPH_LAST - GLYPH_FIRST + 1];
+};
+
+void batch_triangle(struct Batch *batch, float x1, float y1, float x2,
+                    float y2, float x3, float y3, SDL_Color color);
+
+void batch_rect(struct Batch *batch, float x1, float y1, float x2, float y2,
+                SDL_Color color);
+
+void batch_textured_rect(struct Batch *batch, SDL_Rect dst, SDL_Rect src,
+                         int texture_w, int texture_h, SDL_Color color);
+
+void batch_draw(SDL_Renderer *renderer, struct Batch *batch,
+                SDL_Texture *texture);
+
+void glyph_atlas_init(struct GlyphAtlas *atlas, SDL_Renderer *renderer,
+                      TTF_Font *font);
+
+void glyph_atlas_free(struct GlyphAtlas *atlas);
+
+void render(SDL_Renderer *renderer, SDL_Window *window, struct Flock *flock,
+            int followed, struct Widget *widgets, int num_widgets,
             struct Context parent, struct Context child, int frame, int fps,
-            SDL_Color white, struct Quadtree *q, TTF_Font *font,
-            bool debug_view);
+            SDL_Color white, struct SpatialIndex *index,
+            struct SpatialIndex *view_index, TTF_Font *font, bool debug_view,
+            float alpha);
 
 void draw_text(SDL_Renderer *renderer, TTF_Font *font, int x, int y,
                SDL_Color color, char *text);
 
-void draw_quadtree(SDL_Renderer *renderer, struct Quadtree *q,
+void flush_text(SDL_Renderer *renderer);
+
+void draw_quadtree(struct Batch *batch, struct Quadtree *q, int node,
                    struct Context parent, struct Context child, int shade,
                    int shade_increment);
 
-void draw_boid(SDL_Renderer *renderer, struct Boid *boid, struct Context parent,
+void draw_grid(struct Batch *batch, struct Grid *g, struct Context parent,
+               struct Context child, int shade, int shade_increment);
+
+void draw_boid(struct Batch *batch, struct Boid *boid, struct Context parent,
                struct Context child, int id);
 
-void draw_boids(SDL_Renderer *renderer, struct Boid boids[], int num_boids,
-                struct Context parent, struct Context child, bool debug_view,
-                struct Quadtree *q);
+void draw_density(SDL_Renderer *renderer, struct DensityMap *map,
+                  struct Flock *flock, int *ids, int count,
+                  struct Context parent, struct Context child, float alpha);
+
+void draw_boids(SDL_Renderer *renderer, struct Batch *batch,
+                struct Flock *flock, int followed, struct Context parent,
+                struct Context child, bool debug_view,
+                struct SpatialIndex *index, struct SpatialIndex *view_index,
+                float alpha);
 
 #endif
@@ -0,0 +1,139 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <reorder.h>
+
+// Sorts every interval frames, or never if interval is 0.
+void reorder_init(struct Reorder *r, int interval) {
+  memset(r, 0, sizeof(struct Reorder));
+  r->interval = interval;
+}
+
+void reorder_free(struct Reorder *r) {
+  free(r->codes);
+  free(r->sortedCodes);
+  free(r->order);
+  free(r->sortedOrder);
+  memset(r, 0, sizeof(struct Reorder));
+}
+
+// Spreads the low 16 bits of v out to the even bits.
+unsigned int morton_spread(unsigned int v) {
+  v &= 0xffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Interleaves the bits of the position quantized to 16 bits per axis, so
+// sorting by the code walks the world along a Z-order curve.
+unsigned int morton_code(float x, float y, float w, float h) {
+  float qx = x / w * 65535;
+  float qy = y / h * 65535;
+  qx = qx < 0 ? 0 : qx > 65535 ? 65535 : qx;
+  qy = qy < 0 ? 0 : qy > 65535 ? 65535 : qy;
+  return morton_spread(qx) | morton_spread(qy) << 1;
+}
+
+// Mean wrapped distance between boids next to each other in storage, relative
+// to the spacing of the same number of boids spread evenly over the world.
+// Manhattan distance keeps the square roots out of a pass over every boid.
+float reorder_locality(struct Flock *flock, float w, float h) {
+  if (flock->count < 2) {
+    return 0;
+  }
+
+  float sum = 0;
+  for (int i = 1; i < flock->count; i++) {
+    float dx = fabsf(flock->x[i] - flock->x[i - 1]);
+    float dy = fabsf(flock->y[i] - flock->y[i - 1]);
+    dx = dx > w / 2 ? w - dx : dx;
+    dy = dy > h / 2 ? h - dy : dy;
+    sum += dx + dy;
+  }
+
+  float spacing = sqrtf(w * h / flock->count);
+  return sum / (flock->count - 1) / spacing;
+}
+
+// Depends only on the frame and the flock, so a run resumed from a snapshot
+// sorts on the same frames as the original.
+bool reorder_due(struct Reorder *r, struct Flock *flock, int frame, float w,
+                 float h) {
+  if (r->interval <= 0 || flock->count < 2) {
+    return false;
+  }
+
+  if (frame % r->interval == 0) {
+    return true;
+  }
+
+  // Measuring locality is itself a pass over the flock, so it is only done
+  // now and then.
+  if (frame % REORDER_CHECK_INTERVAL != 0) {
+    return false;
+  }
+
+  return reorder_locality(flock, w, h) > REORDER_LOCALITY_LIMIT;
+}
+
+// Sorts the flock by Morton code with a stable four pass radix sort, then
+// replaces each of the num_ids entries of ids with the boid's new id.
+void reorder_flock(struct Reorder *r, struct Flock *flock, float w, float h,
+                   int *ids, int num_ids) {
+  int n = flock->count;
+
+  if (n > r->capacity) {
+    r->capacity = n;
+    r->codes = realloc(r->codes, sizeof(unsigned int) * n);
+    r->sortedCodes = realloc(r->sortedCodes, sizeof(unsigned int) * n);
+    r->order = realloc(r->order, sizeof(int) * n);
+    r->sortedOrder = realloc(r->sortedOrder, sizeof(int) * n);
+  }
+
+  for (int i = 0; i < n; i++) {
+    r->codes[i] = morton_code(flock->x[i], flock->y[i], w, h);
+    r->order[i] = i;
+  }
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    int offsets[257] = {0};
+    for (int i = 0; i < n; i++) {
+      offsets[((r->codes[i] >> shift) & 0xff) + 1]++;
+    }
+    for (int d = 0; d < 256; d++) {
+      offsets[d + 1] += offsets[d];
+    }
+    for (int i = 0; i < n; i++) {
+      int slot = offsets[(r->codes[i] >> shift) & 0xff]++;
+      r->sortedCodes[slot] = r->codes[i];
+      r->sortedOrder[slot] = r->order[i];
+    }
+
+    unsigned int *codes = r->codes;
+    r->codes = r->sortedCodes;
+    r->sortedCodes = codes;
+
+    int *order = r->order;
+    r->order = r->sortedOrder;
+    r->sortedOrder = order;
+  }
+
+  flock_permute(flock, r->order);
+
+  // The scratch order array is free again, so it holds the inverse.
+  int *new_id = r->sortedOrder;
+  for (int i = 0; i < n; i++) {
+    new_id[r->order[i]] = i;
+  }
+  for (int i = 0; i < num_ids; i++) {
+    if (ids[i] >= 0 && ids[i] < n) {
+      ids[i] = new_id[ids[i]];
+    }
+  }
+
+  r->count++;
+}
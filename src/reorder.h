@@ -0,0 +1,43 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <stdbool.h>
+
+#include <flock.h>
+
+// Frames between sorts of the flock storage by Morton code.
+#define REORDER_INTERVAL 500
+
+// The flock is also sorted early once boids next to each other in storage are
+// on average this many times further apart than evenly spread boids would be,
+// which is checked every REORDER_CHECK_INTERVAL frames.
+#define REORDER_LOCALITY_LIMIT 8
+#define REORDER_CHECK_INTERVAL 32
+
+// Keeps boids that are close in the world close in memory, so the neighbors
+// gathered by the rules share cache lines. Sorting moves boids to new ids, so
+// ids held elsewhere must be remapped and persistent indexes reset.
+struct Reorder {
+  int interval;
+  int count;
+
+  unsigned int *codes;
+  unsigned int *sortedCodes;
+  int *order;
+  int *sortedOrder;
+  int capacity;
+};
+
+void reorder_init(struct Reorder *r, int interval);
+
+void reorder_free(struct Reorder *r);
+
+float reorder_locality(struct Flock *flock, float w, float h);
+
+bool reorder_due(struct Reorder *r, struct Flock *flock, int frame, float w,
+                 float h);
+
+void reorder_flock(struct Reorder *r, struct Flock *flock, float w, float h,
+                   int *ids, int num_ids);
+
+#endif
@@ -0,0 +1,359 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <profiler.h>
+#include <random.h>
+#include <simulation.h>
+
+struct ScreenSize screen_size = {1200, 700};
+
+struct RandomState random_state = {0};
+
+// Random streams, each keyed by the seed and a step or spawn counter.
+enum {
+  STREAM_SPAWN_X,
+  STREAM_SPAWN_Y,
+  STREAM_SPAWN_HEADING,
+  STREAM_NOISE,
+};
+
+void initialize_widgets(struct Widget *widgets) {
+  // Typical values:
+  // Separation 0.04,
+  // Alignment  0.01,
+  // Cohesion   0.0025,
+  widgets[0].min = 0.0;
+  widgets[0].max = 0.005 * 4;
+  widgets[0].value_f = 0.0025;
+  widgets[0].type = WIDGET_SLIDER;
+  snprintf(widgets[0].name, 100, "Cohesion");
+
+  widgets[1].min = 0.0;
+  widgets[1].max = 0.02 * 4;
+  widgets[1].value_f = 0.01;
+  widgets[1].type = WIDGET_SLIDER;
+  snprintf(widgets[1].name, 100, "Alignment");
+
+  widgets[2].min = 0.0;
+  widgets[2].max = 0.08 * 4;
+  widgets[2].value_f = 0.04;
+  widgets[2].type = WIDGET_SLIDER;
+  snprintf(widgets[2].name, 100, "Separation");
+
+  widgets[3].min = 0.5;
+  widgets[3].max = 4.0;
+  widgets[3].value_f = 1.0;
+  widgets[3].type = WIDGET_SLIDER;
+  snprintf(widgets[3].name, 100, "Speed");
+
+  widgets[4].value_b = false;
+  widgets[4].type = WIDGET_CHECKBOX;
+  snprintf(widgets[4].name, 100, "Paused");
+
+  widgets[5].value_b = false;
+  widgets[5].type = WIDGET_CHECKBOX;
+  snprintf(widgets[5].name, 100, "Follow mode");
+}
+
+// The n-th boid ever spawned gets its position and heading from counter n of
+// the spawn streams, so boids added later in dynamic mode do not repeat
+// earlier ones.
+void add_boid(struct Flock *flock) {
+  flock_reserve(flock, flock->count + 1);
+
+  unsigned int seed = random_state.seed;
+  unsigned int n = random_state.spawned;
+  int i = flock->count;
+
+  flock->x[i] = random_float_at(random_key(seed, STREAM_SPAWN_X, 0), n, 0,
+                                screen_size.width);
+  flock->y[i] = random_float_at(random_key(seed, STREAM_SPAWN_Y, 0), n, 0,
+                                screen_size.height);
+  float heading = random_float_at(random_key(seed, STREAM_SPAWN_HEADING, 0), n,
+                                  0, 3.141 * 2);
+  flock->vx[i] = cos(heading);
+  flock->vy[i] = sin(heading);
+  flock->prev_x[i] = flock->x[i];
+  flock->prev_y[i] = flock->y[i];
+
+  flock->count++;
+  random_state.spawned++;
+}
+
+void remove_boid(struct Flock *flock) {
+  if (flock->count > 0) {
+    flock->count--;
+  }
+}
+
+// Spawns n boids in one batch, giving the same boids as n calls to add_boid.
+void initialize_positions(struct Flock *flock, int n) {
+  flock_reserve(flock, n);
+
+  unsigned int seed = random_state.seed;
+  unsigned int first = random_state.spawned;
+
+  random_fill(flock->x, n, random_key(seed, STREAM_SPAWN_X, 0), first, 0,
+              screen_size.width);
+  random_fill(flock->y, n, random_key(seed, STREAM_SPAWN_Y, 0), first, 0,
+              screen_size.height);
+
+  // Headings are generated into vx and then turned into unit vectors.
+  random_fill(flock->vx, n, random_key(seed, STREAM_SPAWN_HEADING, 0), first,
+              0, 3.141 * 2);
+  for (int i = 0; i < n; i++) {
+    float heading = flock->vx[i];
+    flock->vx[i] = cos(heading);
+    flock->vy[i] = sin(heading);
+  }
+
+  flock->count = n;
+  flock_save_positions(flock);
+  random_state.spawned += n;
+}
+
+// Shortest signed difference between two coordinates on a wrapping axis.
+float wrap_delta(float d, float size) {
+  if (d > size / 2) {
+    return d - size;
+  }
+
+  if (d < -size / 2) {
+    return d + size;
+  }
+
+  return d;
+}
+
+// Position of boid i a fraction alpha of the way through the last step, taking
+// the short way across the wrap-around edge.
+void interpolate_position(struct Flock *flock, int i, float alpha, float *x,
+                          float *y) {
+  float dx = wrap_delta(flock->x[i] - flock->prev_x[i], screen_size.width);
+  float dy = wrap_delta(flock->y[i] - flock->prev_y[i], screen_size.height);
+  *x = flock->prev_x[i] + alpha * dx;
+  *y = flock->prev_y[i] + alpha * dy;
+}
+
+// Scales (*x, *y) to unit length. A zero vector becomes (1, 0), the direction
+// of atan2(0, 0).
+void normalize(float *x, float *y) {
+  float length_2 = *x * *x + *y * *y;
+
+  if (length_2 > 0) {
+    float scale = 1 / sqrtf(length_2);
+    *x *= scale;
+    *y *= scale;
+  } else {
+    *x = 1;
+    *y = 0;
+  }
+}
+
+// Separation, alignment and cohesion share one radius query, which hands back
+// the offset and squared distance to each neighbor. steer_x/steer_y[0..2] keep
+// the output of each rule for the debug view.
+//
+// separation: steer to avoid crowding local flockmates
+// alignment: steer towards the average heading of local flockmates
+// cohesion: steer to move towards the average position (center of mass) of
+// local flockmates, found as the mean offset to each of them
+void neighbor_rules(struct Flock *flock, int idx, struct SpatialIndex *index,
+                    struct Neighbors *nearby) {
+  float *x = flock->x;
+  float *y = flock->y;
+  float *vx = flock->vx;
+  float *vy = flock->vy;
+
+  float separation_x = vx[idx];
+  float separation_y = vy[idx];
+  float alignment_x = vx[idx];
+  float alignment_y = vy[idx];
+  float cohesion_x = vx[idx];
+  float cohesion_y = vy[idx];
+
+  float sum_x_heading = 0;
+  float sum_y_heading = 0;
+  float sum_x_offset = 0;
+  float sum_y_offset = 0;
+  int n = 0;
+
+  spatial_index_query_radius(index, x, y, x[idx], y[idx], RADIUS_MAX, nearby);
+
+  for (int j = 0; j < nearby->length; j++) {
+    int i = nearby->ids[j];
+    if (i != idx) {
+      float dx = nearby->dx[j];
+      float dy = nearby->dy[j];
+
+      sum_x_heading += vx[i];
+      sum_y_heading += vy[i];
+      sum_x_offset += dx;
+      sum_y_offset += dy;
+      n++;
+
+      if (nearby->dist_2[j] < RADIUS_MIN * RADIUS_MIN) {
+        separation_x = -dx;
+        separation_y = -dy;
+      }
+    }
+  }
+
+  normalize(&separation_x, &separation_y);
+
+  if (n != 0) {
+    alignment_x = sum_x_heading;
+    alignment_y = sum_y_heading;
+    normalize(&alignment_x, &alignment_y);
+
+    cohesion_x = sum_x_offset / (float)n;
+    cohesion_y = sum_y_offset / (float)n;
+    normalize(&cohesion_x, &cohesion_y);
+  }
+
+  flock->steer_x[0][idx] = separation_x;
+  flock->steer_y[0][idx] = separation_y;
+  flock->steer_x[1][idx] = alignment_x;
+  flock->steer_y[1][idx] = alignment_y;
+  flock->steer_x[2][idx] = cohesion_x;
+  flock->steer_y[2][idx] = cohesion_y;
+}
+
+// noise: steer in random directions
+//
+// Rotates the velocity by a small random angle, using the first terms of the
+// cos and sin series, which are accurate to 1e-5 for angles up to 0.1. The
+// angle depends only on the seed, the step and the boid.
+void rule4(struct Flock *flock, int idx, unsigned int key) {
+  float angle = random_float_at(key, idx, -0.1, 0.1);
+  float c = 1 - angle * angle / 2;
+  float s = angle - angle * angle * angle / 6;
+
+  flock->steer_x[3][idx] = c * flock->vx[idx] - s * flock->vy[idx];
+  flock->steer_y[3][idx] = s * flock->vx[idx] + c * flock->vy[idx];
+}
+
+struct SimulationPass {
+  struct Flock *flock;
+  struct SpatialIndex *index;
+  struct Neighbors *nearby;
+  unsigned int noise_key;
+  float heading_weight;
+  float weights[4];
+};
+
+void move_pass(void *context, int begin, int end, int worker) {
+  struct SimulationPass *pass = context;
+  float *restrict x = pass->flock->x;
+  float *restrict y = pass->flock->y;
+  float *restrict vx = pass->flock->vx;
+  float *restrict vy = pass->flock->vy;
+
+  for (int i = begin; i < end; i++) {
+    x[i] += BOID_SPEED * vx[i];
+    y[i] += BOID_SPEED * vy[i];
+  }
+
+  // Written as selects rather than branches so the loop vectorizes.
+  float width = screen_size.width;
+  float height = screen_size.height;
+  for (int i = begin; i < end; i++) {
+    float xi = x[i];
+    float yi = y[i];
+    xi = xi > width ? 0 : xi;
+    xi = xi < 0 ? width : xi;
+    yi = yi > height ? 0 : yi;
+    yi = yi < 0 ? height : yi;
+    x[i] = xi;
+    y[i] = yi;
+  }
+}
+
+// Each boid only writes its own steering, so workers never share output.
+void rules_pass(void *context, int begin, int end, int worker) {
+  struct SimulationPass *pass = context;
+
+  for (int i = begin; i < end; i++) {
+    neighbor_rules(pass->flock, i, pass->index, &pass->nearby[worker]);
+  }
+
+  for (int i = begin; i < end; i++) {
+    rule4(pass->flock, i, pass->noise_key);
+  }
+}
+
+// Blends the current velocity with the rule outputs and renormalizes, which
+// is the vector form of averaging their headings by weight.
+void integrate_pass(void *context, int begin, int end, int worker) {
+  struct SimulationPass *pass = context;
+  struct Flock *flock = pass->flock;
+  float *restrict x = flock->x;
+  float *restrict y = flock->y;
+  float *restrict vx = flock->vx;
+  float *restrict vy = flock->vy;
+  float heading_weight = pass->heading_weight;
+  float *weights = pass->weights;
+
+  for (int i = begin; i < end; i++) {
+    float new_x = heading_weight * vx[i];
+    float new_y = heading_weight * vy[i];
+
+    for (int k = 0; k < 4; k++) {
+      new_x += weights[k] * flock->steer_x[k][i];
+      new_y += weights[k] * flock->steer_y[k][i];
+    }
+
+    normalize(&new_x, &new_y);
+    vx[i] = new_x;
+    vy[i] = new_y;
+
+    x[i] += BOID_SPEED * new_x;
+    y[i] += BOID_SPEED * new_y;
+  }
+}
+
+void simulate_boids(struct Flock *flock, struct Widget *widgets,
+                    int num_widgets, struct SpatialIndex *index,
+                    struct Workers *workers) {
+  static struct Neighbors *nearby = NULL;
+  static int num_nearby = 0;
+
+  if (num_nearby < workers->count) {
+    nearby = realloc(nearby, sizeof(struct Neighbors) * workers->count);
+    for (int i = num_nearby; i < workers->count; i++) {
+      nearby[i] = (struct Neighbors){0};
+    }
+    num_nearby = workers->count;
+  }
+
+  struct SimulationPass pass;
+  pass.flock = flock;
+  pass.index = index;
+  pass.nearby = nearby;
+  pass.noise_key =
+      random_key(random_state.seed, STREAM_NOISE, random_state.step);
+  pass.heading_weight = widgets[3].value_f;
+  pass.weights[0] = widgets[2].value_f;
+  pass.weights[1] = widgets[1].value_f;
+  pass.weights[2] = widgets[0].value_f;
+  pass.weights[3] = 0.0;
+
+  // The rules run first, on the positions the caller indexed. Moving comes
+  // last, so the positions left for the next index build are the ones the
+  // next rules pass reads, already wrapped into the world.
+  profiler_begin(PHASE_RULES);
+  workers_run(workers, rules_pass, &pass, flock->count);
+  profiler_end(PHASE_RULES);
+
+  profiler_begin(PHASE_INTEGRATE);
+  workers_run(workers, integrate_pass, &pass, flock->count);
+  profiler_end(PHASE_INTEGRATE);
+
+  profiler_begin(PHASE_MOVE);
+  workers_run(workers, move_pass, &pass, flock->count);
+  profiler_end(PHASE_MOVE);
+
+  random_state.step++;
+}
@@ -0,0 +1,41 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <flock.h>
+#include <main.h>
+#include <spatial_index.h>
+#include <workers.h>
+
+struct ScreenSize {
+  int width;
+  int height;
+};
+
+extern struct ScreenSize screen_size;
+
+// Everything random in the simulation is derived from these counters, so
+// saving them is enough to reproduce a run.
+struct RandomState {
+  unsigned int seed;
+  unsigned int step;
+  unsigned int spawned;
+};
+
+extern struct RandomState random_state;
+
+void initialize_widgets(struct Widget *widgets);
+
+void add_boid(struct Flock *flock);
+
+void remove_boid(struct Flock *flock);
+
+void initialize_positions(struct Flock *flock, int n);
+
+void interpolate_position(struct Flock *flock, int i, float alpha, float *x,
+                          float *y);
+
+void simulate_boids(struct Flock *flock, struct Widget *widgets,
+                    int num_widgets, struct SpatialIndex *index,
+                    struct Workers *workers);
+
+#endif
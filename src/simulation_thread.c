@@ -0,0 +1,214 @@
+#include <string.h>
+#include <time.h>
+
+#include <profiler.h>
+#include <simulation.h>
+#include <simulation_thread.h>
+
+// Sleeps until time on the CLOCK_MONOTONIC clock read by profiler_now.
+void simulation_thread_sleep_until(double time) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)time;
+  ts.tv_nsec = (long)((time - ts.tv_sec) * 1e9);
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// Copies the simulation state into the back frame and swaps it into the
+// middle. The renderer only reads positions and velocities, and the steering
+// vectors of the followed boid for the debug overlay, so only those are
+// copied.
+void simulation_thread_publish(struct SimulationThread *sim) {
+  struct SimulationFrame *frame = &sim->frames[sim->back];
+  flock_copy_motion(&frame->flock, &sim->flock);
+
+  int followed = sim->followed;
+  if (followed < sim->flock.count) {
+    for (int i = 0; i < 4; i++) {
+      frame->flock.steer_x[i][followed] = sim->flock.steer_x[i][followed];
+      frame->flock.steer_y[i][followed] = sim->flock.steer_y[i][followed];
+    }
+  }
+
+  frame->random_state = random_state;
+  frame->frame = sim->frame;
+  frame->time = profiler_now();
+  frame->followed = sim->followed;
+  frame->reorders = sim->reorder.count;
+
+  sim->back = atomic_exchange(&sim->middle, sim->back | SIMULATION_FRAME_FRESH) &
+              ~SIMULATION_FRAME_FRESH;
+}
+
+void *simulation_thread_main(void *arg) {
+  struct SimulationThread *sim = arg;
+  struct Widget widgets[NUM_WIDGETS];
+
+  if (sim->recorder) {
+    recorder_write(sim->recorder, &sim->flock, sim->frame);
+  }
+
+  double next = profiler_now();
+  while (true) {
+    pthread_mutex_lock(&sim->mutex);
+    bool running = sim->running;
+    bool paused = sim->paused;
+    int pending_boids = sim->pending_boids;
+    sim->pending_boids = 0;
+    memcpy(widgets, sim->widgets, sizeof(widgets));
+    pthread_mutex_unlock(&sim->mutex);
+
+    if (!running) {
+      break;
+    }
+
+    // Nothing the renderer sees changes while paused, unless boids were
+    // added or removed.
+    bool changed = !paused || pending_boids != 0;
+
+    for (; pending_boids > 0; pending_boids--) {
+      add_boid(&sim->flock);
+    }
+    for (; pending_boids < 0; pending_boids++) {
+      remove_boid(&sim->flock);
+    }
+
+    // While paused prev matches the current positions, so nothing moves.
+    flock_save_positions(&sim->flock);
+
+    if (!paused) {
+      if (reorder_due(&sim->reorder, &sim->flock, sim->frame,
+                      screen_size.width, screen_size.height)) {
+        reorder_flock(&sim->reorder, &sim->flock, screen_size.width,
+                      screen_size.height, &sim->followed, 1);
+        spatial_index_reset(&sim->index);
+      }
+
+      profiler_begin(PHASE_INDEX_BUILD);
+      spatial_index_build(&sim->index, sim->flock.x, sim->flock.y,
+                          sim->flock.count, screen_size.width,
+                          screen_size.height, RADIUS_MAX, sim->workers);
+      profiler_end(PHASE_INDEX_BUILD);
+      simulate_boids(&sim->flock, widgets, NUM_WIDGETS, &sim->index,
+                     sim->workers);
+      spatial_index_clear(&sim->index);
+      sim->frame++;
+
+      if (sim->recorder) {
+        recorder_write(sim->recorder, &sim->flock, sim->frame);
+      }
+    }
+
+    if (changed) {
+      simulation_thread_publish(sim);
+    }
+
+    // Steps are paced to the rate. After falling too far behind, the missed
+    // time is dropped rather than caught up on.
+    double now = profiler_now();
+    next += sim->step_time;
+    if (next < now - MAX_FRAME_TIME) {
+      next = now;
+    }
+    simulation_thread_sleep_until(next);
+  }
+
+  return NULL;
+}
+
+// Takes over the flock, which the thread simulates from the given frame until
+// stopped. Workers and random_state are only used by the simulation thread
+// from then on. Each step is recorded if recorder is not NULL.
+void simulation_thread_start(struct SimulationThread *sim, struct Flock *flock,
+                             int index_type, int leaf_capacity,
+                             struct Workers *workers,
+                             struct Recorder *recorder, int rate, int frame,
+                             struct Widget *widgets, bool paused) {
+  pthread_mutex_init(&sim->mutex, NULL);
+  memcpy(sim->widgets, widgets, sizeof(sim->widgets));
+  sim->paused = paused;
+  sim->running = true;
+  sim->pending_boids = 0;
+
+  sim->flock = *flock;
+  sim->index = (struct SpatialIndex){0};
+  sim->index.type = index_type;
+  quadtree_configure(&sim->index.quadtree, leaf_capacity,
+                     QUADTREE_DEFAULT_DEPTH);
+  sim->workers = workers;
+  sim->recorder = recorder;
+  reorder_init(&sim->reorder, REORDER_INTERVAL);
+  sim->followed = 0;
+  sim->step_time = 1.0 / rate;
+  sim->frame = frame;
+
+  for (int i = 0; i < SIMULATION_FRAMES; i++) {
+    flock_init(&sim->frames[i].flock, flock->count);
+    flock_copy(&sim->frames[i].flock, flock);
+    sim->frames[i].random_state = random_state;
+    sim->frames[i].frame = frame;
+    sim->frames[i].time = profiler_now();
+    sim->frames[i].followed = 0;
+    sim->frames[i].reorders = 0;
+  }
+  sim->front = 0;
+  atomic_init(&sim->middle, 1);
+  sim->back = 2;
+
+  pthread_create(&sim->thread, NULL, simulation_thread_main, sim);
+}
+
+void simulation_thread_set_controls(struct SimulationThread *sim,
+                                    struct Widget *widgets, bool paused) {
+  pthread_mutex_lock(&sim->mutex);
+  memcpy(sim->widgets, widgets, sizeof(sim->widgets));
+  sim->paused = paused;
+  pthread_mutex_unlock(&sim->mutex);
+}
+
+// Adds n boids before the next step, or removes them if n is negative.
+void simulation_thread_add_boids(struct SimulationThread *sim, int n) {
+  pthread_mutex_lock(&sim->mutex);
+  sim->pending_boids += n;
+  pthread_mutex_unlock(&sim->mutex);
+}
+
+// The most recent completed step. It stays valid and unchanged until the next
+// call.
+struct SimulationFrame *simulation_thread_acquire(struct SimulationThread *sim) {
+  if (atomic_load(&sim->middle) & SIMULATION_FRAME_FRESH) {
+    sim->front = atomic_exchange(&sim->middle, sim->front) &
+                 ~SIMULATION_FRAME_FRESH;
+  }
+
+  return &sim->frames[sim->front];
+}
+
+// How far the renderer is into the step after frame, for drawing between its
+// previous and current positions. This puts the drawing one step behind the
+// simulation.
+float simulation_thread_alpha(struct SimulationThread *sim,
+                              struct SimulationFrame *frame) {
+  float alpha = (profiler_now() - frame->time) / sim->step_time;
+
+  if (alpha > 1) {
+    alpha = 1;
+  }
+
+  return alpha;
+}
+
+void simulation_thread_stop(struct SimulationThread *sim) {
+  pthread_mutex_lock(&sim->mutex);
+  sim->running = false;
+  pthread_mutex_unlock(&sim->mutex);
+
+  pthread_join(sim->thread, NULL);
+  pthread_mutex_destroy(&sim->mutex);
+
+  for (int i = 0; i < SIMULATION_FRAMES; i++) {
+    flock_free(&sim->frames[i].flock);
+  }
+  reorder_free(&sim->reorder);
+  spatial_index_free(&sim->index);
+  flock_free(&sim->flock);
+}
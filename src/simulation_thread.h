@@ -0,0 +1,86 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include <flock.h>
+#include <main.h>
+#include <recording.h>
+#include <reorder.h>
+#include <simulation.h>
+#include <spatial_index.h>
+#include <workers.h>
+
+#define SIMULATION_FRAMES 3
+
+// Set in SimulationThread.middle when the middle frame is newer than the one
+// the renderer holds.
+#define SIMULATION_FRAME_FRESH 4
+
+// A completed step, as handed to the renderer. followed is the id of the boid
+// the follow view tracks, and reorders changes whenever ids were reassigned.
+struct SimulationFrame {
+  struct Flock flock;
+  struct RandomState random_state;
+  int frame;
+  double time;
+  int followed;
+  int reorders;
+};
+
+// Runs the simulation at a fixed rate on its own thread, so the main thread
+// only handles events and rendering.
+//
+// Completed steps are handed over through a triple buffer: the simulation
+// fills the back frame, then swaps it with the middle one, and the renderer
+// swaps its front frame with the middle one when a fresh one is there. Both
+// swaps are a single atomic exchange, so neither side ever waits on the other.
+struct SimulationThread {
+  pthread_t thread;
+
+  // Controls set by the main thread, guarded by mutex.
+  pthread_mutex_t mutex;
+  struct Widget widgets[NUM_WIDGETS];
+  bool paused;
+  bool running;
+  int pending_boids;
+
+  // Owned by the simulation thread.
+  struct Flock flock;
+  struct SpatialIndex index;
+  struct Workers *workers;
+  struct Recorder *recorder;
+  struct Reorder reorder;
+  int followed;
+  double step_time;
+  int frame;
+  int back;
+
+  // Owned by the renderer.
+  int front;
+
+  struct SimulationFrame frames[SIMULATION_FRAMES];
+  atomic_int middle;
+};
+
+void simulation_thread_start(struct SimulationThread *sim, struct Flock *flock,
+                             int index_type, int leaf_capacity,
+                             struct Workers *workers,
+                             struct Recorder *recorder, int rate, int frame,
+                             struct Widget *widgets, bool paused);
+
+void simulation_thread_set_controls(struct SimulationThread *sim,
+                                    struct Widget *widgets, bool paused);
+
+void simulation_thread_add_boids(struct SimulationThread *sim, int n);
+
+struct SimulationFrame *simulation_thread_acquire(struct SimulationThread *sim);
+
+float simulation_thread_alpha(struct SimulationThread *sim,
+                              struct SimulationFrame *frame);
+
+void simulation_thread_stop(struct SimulationThread *sim);
+
+#endif
@@ -0,0 +1,93 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <snapshot.h>
+
+// Writes the header and the boid arrays with a single writev, without
+// copying the arrays. Failures are reported without exiting, so a failed save
+// does not end a run.
+void snapshot_save(const char *path, struct Flock *flock,
+                   struct Widget *widgets, struct RandomState *random_state,
+                   int frame) {
+  struct SnapshotHeader header = {0};
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.count = flock->count;
+  header.frame = frame;
+  header.width = screen_size.width;
+  header.height = screen_size.height;
+  header.random_state = *random_state;
+  for (int i = 0; i < NUM_WIDGETS; i++) {
+    header.value_f[i] = widgets[i].value_f;
+    header.value_b[i] = widgets[i].value_b;
+  }
+
+  size_t size = sizeof(float) * flock->count;
+  struct iovec parts[5] = {
+      {&header, sizeof(header)}, {flock->x, size},  {flock->y, size},
+      {flock->vx, size},         {flock->vy, size},
+  };
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    perror(path);
+    return;
+  }
+
+  ssize_t expected = sizeof(header) + 4 * size;
+  if (writev(fd, parts, 5) != expected) {
+    perror(path);
+  }
+
+  close(fd);
+}
+
+// Reads a snapshot straight into the flock storage and restores the widgets,
+// the random state and the world size. Returns the frame it was taken at.
+int snapshot_load(const char *path, struct Flock *flock,
+                  struct Widget *widgets) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  struct SnapshotHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION || header.count < 0) {
+    fprintf(stderr, "Not a snapshot: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  flock->count = 0;
+  flock_reserve(flock, header.count);
+
+  float *arrays[4] = {flock->x, flock->y, flock->vx, flock->vy};
+  for (int i = 0; i < 4; i++) {
+    if (fread(arrays[i], sizeof(float), header.count, file) !=
+        (size_t)header.count) {
+      fprintf(stderr, "Truncated snapshot: %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  fclose(file);
+
+  flock->count = header.count;
+  flock_save_positions(flock);
+
+  for (int i = 0; i < NUM_WIDGETS; i++) {
+    widgets[i].value_f = header.value_f[i];
+    widgets[i].value_b = header.value_b[i];
+  }
+
+  random_state = header.random_state;
+  screen_size.width = header.width;
+  screen_size.height = header.height;
+
+  return header.frame;
+}
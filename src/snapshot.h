@@ -0,0 +1,34 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include <flock.h>
+#include <main.h>
+#include <simulation.h>
+
+#define SNAPSHOT_MAGIC "BOIDSNP1"
+#define SNAPSHOT_VERSION 1
+
+// A snapshot is this header followed by the x, y, vx and vy arrays of the
+// flock, count floats each.
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t count;
+  int32_t frame;
+  int32_t width;
+  int32_t height;
+  struct RandomState random_state;
+  float value_f[NUM_WIDGETS];
+  int32_t value_b[NUM_WIDGETS];
+};
+
+void snapshot_save(const char *path, struct Flock *flock,
+                   struct Widget *widgets, struct RandomState *random_state,
+                   int frame);
+
+int snapshot_load(const char *path, struct Flock *flock,
+                  struct Widget *widgets);
+
+#endif
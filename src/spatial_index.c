@@ -0,0 +1,160 @@
+#include <string.h>
+
+#include <spatial_index.h>
+
+int spatial_index_type(const char *name) {
+  if (strcmp(name, "quadtree") == 0) {
+    return INDEX_QUADTREE;
+  }
+
+  if (strcmp(name, "grid") == 0) {
+    return INDEX_GRID;
+  }
+
+  return -1;
+}
+
+// The grid persists between frames and only moves boids that changed cell,
+// while the quadtree is rebuilt from scratch into its reused node array.
+void spatial_index_build(struct SpatialIndex *index, const float *x,
+                         const float *y, int num_boids, float w, float h,
+                         float cell_size, struct Workers *workers) {
+  index->w = w;
+  index->h = h;
+
+  if (index->type == INDEX_GRID) {
+    grid_update(&index->grid, x, y, num_boids, w, h, cell_size, workers);
+  } else {
+    quadtree_init(&index->quadtree, w, h);
+
+    for (int i = 0; i < num_boids; i++) {
+      quadtree_insert(&index->quadtree, i, x[i], y[i]);
+    }
+  }
+}
+
+// Ends the frame. Both indexes keep their storage for the next build.
+void spatial_index_clear(struct SpatialIndex *index) {
+  if (index->type == INDEX_QUADTREE) {
+    quadtree_clear(&index->quadtree);
+  }
+}
+
+void spatial_index_free(struct SpatialIndex *index) {
+  quadtree_free(&index->quadtree);
+  grid_free(&index->grid);
+}
+
+// Makes the next build start from scratch. Needed whenever boid ids are
+// reassigned rather than moved.
+void spatial_index_reset(struct SpatialIndex *index) {
+  index->grid.stale = true;
+}
+
+void spatial_index_query_box(struct SpatialIndex *index, int x, int y, int w,
+                             int h, struct Neighbors *result) {
+  if (index->type == INDEX_GRID) {
+    grid_query(&index->grid, x, y, w, h, result);
+  } else {
+    quadtree_query(&index->quadtree, x, y, w, h, result);
+  }
+}
+
+// Splits [x, x + w) of a world of the given size into the part starting at x
+// and the part wrapped around to 0, returning the number of parts.
+int wrap_span(int x, int w, int size, int *starts, int *widths) {
+  if (w > size) {
+    w = size;
+  }
+
+  x %= size;
+  if (x < 0) {
+    x += size;
+  }
+
+  starts[0] = x;
+  widths[0] = w;
+
+  if (x + w <= size) {
+    return 1;
+  }
+
+  widths[0] = size - x;
+  starts[1] = 0;
+  widths[1] = w - widths[0];
+
+  return 2;
+}
+
+// Replaces the contents of result with the ids found in the given box, which
+// may extend past the edges of the world. Boxes crossing an edge are split
+// into up to four pieces, one per corner of the world they reach.
+void spatial_index_query(struct SpatialIndex *index, int x, int y, int w, int h,
+                         struct Neighbors *result) {
+  result->length = 0;
+
+  if (index->w <= 0 || index->h <= 0) {
+    return;
+  }
+
+  int xs[2];
+  int ws[2];
+  int ys[2];
+  int hs[2];
+  int num_x = wrap_span(x, w, index->w, xs, ws);
+  int num_y = wrap_span(y, h, index->h, ys, hs);
+
+  for (int i = 0; i < num_y; i++) {
+    for (int j = 0; j < num_x; j++) {
+      spatial_index_query_box(index, xs[j], ys[i], ws[j], hs[i], result);
+    }
+  }
+}
+
+// Positions of the copies of c, on an axis of the given size, whose circles of
+// the given radius reach into the world, returning their number.
+int wrap_images(float c, float radius, float size, float *images) {
+  int n = 0;
+  images[n++] = c;
+
+  if (c - radius < 0) {
+    images[n++] = c + size;
+  }
+
+  if (c + radius > size) {
+    images[n++] = c - size;
+  }
+
+  return n;
+}
+
+// Replaces the contents of result with the boids closer than radius to (x, y)
+// and their offsets from it, which point to the nearest image of each boid
+// across the wrap-around edges. The circle is tested against each copy of the
+// center that reaches into the world, so no boid is found twice as long as the
+// radius is under half the world size.
+void spatial_index_query_radius(struct SpatialIndex *index, const float *x,
+                                const float *y, float cx, float cy,
+                                float radius, struct Neighbors *result) {
+  result->length = 0;
+
+  if (index->w <= 0 || index->h <= 0) {
+    return;
+  }
+
+  float xs[3];
+  float ys[3];
+  int num_x = wrap_images(cx, radius, index->w, xs);
+  int num_y = wrap_images(cy, radius, index->h, ys);
+
+  for (int i = 0; i < num_y; i++) {
+    for (int j = 0; j < num_x; j++) {
+      if (index->type == INDEX_GRID) {
+        grid_query_radius(&index->grid, x, y, xs[j], ys[i], radius, result);
+      } else {
+        quadtree_query_radius(&index->quadtree, x, y, xs[j], ys[i], radius,
+                              result);
+      }
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <grid.h>
+#include <neighbors.h>
+#include <quadtree.h>
+#include <workers.h>
+
+enum {
+  INDEX_QUADTREE,
+  INDEX_GRID,
+};
+
+// Indexes boids in a w by h world that wraps around at the edges. Queries
+// cover the wrapped box, so callers see neighbors across the seams.
+struct SpatialIndex {
+  int type;
+  int w;
+  int h;
+  struct Quadtree quadtree;
+  struct Grid grid;
+};
+
+int spatial_index_type(const char *name);
+
+void spatial_index_build(struct SpatialIndex *index, const float *x,
+                         const float *y, int num_boids, float w, float h,
+                         float cell_size, struct Workers *workers);
+
+void spatial_index_clear(struct SpatialIndex *index);
+
+void spatial_index_free(struct SpatialIndex *index);
+
+void spatial_index_reset(struct SpatialIndex *index);
+
+void spatial_index_query(struct SpatialIndex *index, int x, int y, int w, int h,
+                         struct Neighbors *result);
+
+void spatial_index_query_radius(struct SpatialIndex *index, const float *x,
+                                const float *y, float cx, float cy,
+                                float radius, struct Neighbors *result);
+
+#endif
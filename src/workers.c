@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <workers.h>
+
+struct WorkerArgs {
+  struct Workers *workers;
+  int worker;
+};
+
+// Items are split into one fixed, ordered range per worker, so which worker
+// handles a given item depends only on n and the worker count. Every worker is
+// called, possibly with an empty range, so per-worker state can be reset.
+void workers_run_range(struct Workers *workers, int worker) {
+  int chunk = (workers->n + workers->count - 1) / workers->count;
+  int begin = worker * chunk;
+  int end = begin + chunk;
+
+  if (begin > workers->n) {
+    begin = workers->n;
+  }
+
+  if (end > workers->n) {
+    end = workers->n;
+  }
+
+  workers->function(workers->context, begin, end, worker);
+}
+
+void *workers_main(void *arg) {
+  struct WorkerArgs *args = arg;
+  struct Workers *workers = args->workers;
+  int worker = args->worker;
+  free(args);
+
+  int generation = 0;
+
+  pthread_mutex_lock(&workers->mutex);
+  while (true) {
+    while (workers->running && workers->generation == generation) {
+      pthread_cond_wait(&workers->start, &workers->mutex);
+    }
+
+    if (!workers->running) {
+      break;
+    }
+
+    generation = workers->generation;
+    pthread_mutex_unlock(&workers->mutex);
+
+    workers_run_range(workers, worker);
+
+    pthread_mutex_lock(&workers->mutex);
+    workers->pending--;
+    if (workers->pending == 0) {
+      pthread_cond_signal(&workers->done);
+    }
+  }
+  pthread_mutex_unlock(&workers->mutex);
+
+  return NULL;
+}
+
+int workers_default_count() {
+  int count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (count < 1) {
+    return 1;
+  }
+
+  return count;
+}
+
+// The calling thread acts as worker 0, so count - 1 threads are started.
+void workers_init(struct Workers *workers, int count) {
+  if (count < 1) {
+    count = 1;
+  }
+
+  workers->count = count;
+  workers->threads = malloc(sizeof(pthread_t) * count);
+  workers->generation = 0;
+  workers->pending = 0;
+  workers->running = true;
+
+  pthread_mutex_init(&workers->mutex, NULL);
+  pthread_cond_init(&workers->start, NULL);
+  pthread_cond_init(&workers->done, NULL);
+
+  for (int i = 1; i < count; i++) {
+    struct WorkerArgs *args = malloc(sizeof(struct WorkerArgs));
+    args->workers = workers;
+    args->worker = i;
+    pthread_create(&workers->threads[i], NULL, workers_main, args);
+  }
+}
+
+// Runs function over [0, n) on all workers and returns once every range is
+// done.
+void workers_run(struct Workers *workers, WorkFunction function, void *context,
+                 int n) {
+  workers->function = function;
+  workers->context = context;
+  workers->n = n;
+
+  if (workers->count > 1) {
+    pthread_mutex_lock(&workers->mutex);
+    workers->pending = workers->count - 1;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->mutex);
+  }
+
+  workers_run_range(workers, 0);
+
+  if (workers->count > 1) {
+    pthread_mutex_lock(&workers->mutex);
+    while (workers->pending > 0) {
+      pthread_cond_wait(&workers->done, &workers->mutex);
+    }
+    pthread_mutex_unlock(&workers->mutex);
+  }
+}
+
+void workers_free(struct Workers *workers) {
+  pthread_mutex_lock(&workers->mutex);
+  workers->running = false;
+  pthread_cond_broadcast(&workers->start);
+  pthread_mutex_unlock(&workers->mutex);
+
+  for (int i = 1; i < workers->count; i++) {
+    pthread_join(workers->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&workers->mutex);
+  pthread_cond_destroy(&workers->start);
+  pthread_cond_destroy(&workers->done);
+  free(workers->threads);
+}
@@ -0,0 +1,37 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Called with a contiguous range [begin, end) of items and the index of the
+// worker running it, which can be used to pick per-worker scratch storage.
+typedef void (*WorkFunction)(void *context, int begin, int end, int worker);
+
+struct Workers {
+  int count;
+  pthread_t *threads;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+
+  int generation;
+  int pending;
+  bool running;
+
+  WorkFunction function;
+  void *context;
+  int n;
+};
+
+int workers_default_count();
+
+void workers_init(struct Workers *workers, int count);
+
+void workers_run(struct Workers *workers, WorkFunction function, void *context,
+                 int n);
+
+void workers_free(struct Workers *workers);
+
+#endif